@@ -0,0 +1,111 @@
+// Runtime anti-aliasing filter design vs the baked tables in aafilter.hpp.
+//
+// For each of the common rates this compares the runtime design with the
+// baked coefficients:
+//  * order and oversampling factor, which should be identical
+//  * worst-case magnitude difference (dB) over the passband
+//  * worst-case stopband attenuation (dB) of each, above the host Nyquist
+// Rates below 40 kHz have their passband corner above the host Nyquist, and
+// rates that aren't oversampled have no stopband, so neither has a stopband
+// to compare. It then lists the designs and design times for other rates.
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "plugin.hpp"
+#include "ripples.hpp"
+
+using namespace ripples;
+
+static const int kImpulseLength = 1 << 14;
+static const int kNumFreqs = 400;
+static const float kOtherRates[] = {16000.f, 32000.f, 37800.f, 50000.f, 64000.f, 100000.f, 144000.f, 250000.f, 1000000.f};
+
+// magnitude response in dB at normalised frequency w (cycles/sample)
+static double MagnitudeDb(const std::vector<float>& impulse, double w) {
+	double re = 0.0, im = 0.0;
+	for (size_t n = 0; n < impulse.size(); n++) {
+		re += impulse[n] * std::cos(2.0 * M_PI * w * n);
+		im -= impulse[n] * std::sin(2.0 * M_PI * w * n);
+	}
+	return 10.0 * std::log10(re * re + im * im + 1e-30);
+}
+
+static std::vector<float> BakedImpulse(float sampleRate, int* factor) {
+	AAFilter<float> filter;
+	filter.Init(sampleRate);
+	*factor = filter.GetOversamplingFactor();
+
+	std::vector<float> impulse(kImpulseLength);
+	for (int n = 0; n < kImpulseLength; n++) {
+		impulse[n] = filter.ProcessUp(n == 0 ? 1.f : 0.f);
+	}
+	return impulse;
+}
+
+static std::vector<float> DesignedImpulse(const AAFilterDesign& design) {
+	SOSFilter<float, ellip::kMaxOrder / 2> filter(design.num_sections);
+	filter.SetCoefficients(design.sections);
+
+	std::vector<float> impulse(kImpulseLength);
+	for (int n = 0; n < kImpulseLength; n++) {
+		impulse[n] = filter.Process(n == 0 ? 1.f : 0.f);
+	}
+	return impulse;
+}
+
+int main() {
+	std::printf("rate     factor  sections  passband diff (dB)  stopband baked (dB)  stopband runtime (dB)\n");
+	for (float rate : kAACommonRates) {
+		AAFilterDesign design;
+		DesignAAFilter(rate, &design);
+
+		int factor;
+		std::vector<float> baked = BakedImpulse(rate, &factor);
+		std::vector<float> designed = DesignedImpulse(design);
+
+		// frequencies normalised to the oversampled rate
+		const double oversampledRate = (double) rate * design.oversampling_factor;
+		const double passband = std::min(kAAPassbandCorner, 0.5f * rate) / oversampledRate;
+		const double stopband = 0.5 * rate / oversampledRate;
+		const bool hasStopband = kAAPassbandCorner < 0.5f * rate && stopband < 0.5;
+
+		double passbandDiff = 0.0;
+		double stopBaked = -1e9, stopDesigned = -1e9;
+		for (int i = 0; i <= kNumFreqs; i++) {
+			const double w = 0.5 * i / kNumFreqs;
+			const double magBaked = MagnitudeDb(baked, w);
+			const double magDesigned = MagnitudeDb(designed, w);
+			if (w <= passband) {
+				passbandDiff = std::max(passbandDiff, std::abs(magBaked - magDesigned));
+			}
+			if (w >= stopband && hasStopband) {
+				stopBaked = std::max(stopBaked, magBaked);
+				stopDesigned = std::max(stopDesigned, magDesigned);
+			}
+		}
+
+		std::printf("%-8g %2d/%-2d   %2d        %10.5f", rate, factor, design.oversampling_factor,
+		            design.num_sections, passbandDiff);
+		if (hasStopband) {
+			std::printf("          %10.1f           %10.1f\n", -stopBaked, -stopDesigned);
+		}
+		else {
+			std::printf("                 n/a                  n/a\n");
+		}
+	}
+
+	// designs with more than 7 sections are not used, AAFilter keeps the table instead
+	std::printf("\nrate     factor  sections  design time (us)\n");
+	for (float rate : kOtherRates) {
+		AAFilterDesign design;
+		auto start = std::chrono::steady_clock::now();
+		DesignAAFilter(rate, &design);
+		auto end = std::chrono::steady_clock::now();
+
+		std::printf("%-8g %2d      %2d        %10.1f\n", rate, design.oversampling_factor, design.num_sections,
+		            std::chrono::duration<double, std::micro>(end - start).count());
+	}
+
+	return 0;
+}
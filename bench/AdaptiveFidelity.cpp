@@ -0,0 +1,146 @@
+// Error and cost of Atlas's adaptive fidelity option.
+//
+// Runs two Atlas modules side by side on the same input, one with "adaptiveFidelity" on and one
+// without, and for each case reports:
+//  * error (dB): energy of the difference between the two outputs relative to the reference, once
+//    both have settled, for inputs where the linear model should take over
+//  * max error (dB): worst difference over any 1 ms window, relative to the reference's RMS over
+//    the run, which includes the crossfades when the level steps across the thresholds
+//  * ns/sample of each module
+// Cases with audio-rate FM or a high cutoff should keep the full model, so their error should be
+// at the noise floor, i.e. far below that of the others.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include <xmmintrin.h>
+#include "plugin.hpp"
+
+static const float kSampleRates[] = {44100.f, 48000.f, 96000.f};
+static const float kSettleTime = 0.3f;
+static const float kRunTime = 2.f;
+static const float kWindowTime = 1e-3f;
+
+// Atlas's channel 1 ids, as in src/Atlas.cpp
+static const int kFreqParam = 0;
+static const int kResParam = 4;
+static const int kInInput = 0;
+static const int kFmInput = 8;
+static const int kOutOutput = 0;
+
+struct Case {
+	const char* name;
+	float cutoff;
+	float resonance;
+	// noise level, the envelope follows its peaks
+	float level;
+	// level is raised to 2.5x for the middle of every second, crossing the full model's threshold
+	bool levelSteps;
+	// audio-rate FM on the FM2 input, in V
+	float fmDepth;
+};
+
+static const Case kCases[] = {
+	{"low level", 200.f, 0.f, 0.3f, false, 0.f},
+	{"low level, resonance", 500.f, 0.1f, 0.3f, false, 0.f},
+	{"at the thresholds", 800.f, 0.1f, 1.9f, false, 0.f},
+	{"level steps", 400.f, 0.1f, 1.2f, true, 0.f},
+	{"audio-rate FM", 400.f, 0.f, 0.3f, false, 0.5f},
+	{"high cutoff", 5000.f, 0.f, 0.3f, false, 0.f},
+};
+
+static Module* CreateAtlas(const char* data, float sampleRate, const Case& c) {
+	Module* module = modelAtlas->createModule();
+	json_t* dataJ = json_loads(data, 0, nullptr);
+	module->dataFromJson(dataJ);
+	json_decref(dataJ);
+
+	Module::SampleRateChangeEvent e;
+	e.sampleRate = sampleRate;
+	e.sampleTime = 1.f / sampleRate;
+	module->onSampleRateChange(e);
+
+	module->params[kFreqParam].setValue(std::log2(c.cutoff));
+	module->params[kResParam].setValue(c.resonance);
+	module->inputs[kInInput].channels = 1;
+	module->inputs[kFmInput].channels = c.fmDepth > 0.f ? 1 : 0;
+	module->outputs[kOutOutput].channels = 1;
+	return module;
+}
+
+// runs the module on the input, returns the output and adds the time taken to ns
+static std::vector<float> Run(Module* module, const std::vector<float>& input, const std::vector<float>& fm,
+                              float sampleRate, double& ns) {
+	Module::ProcessArgs args;
+	args.sampleRate = sampleRate;
+	args.sampleTime = 1.f / sampleRate;
+	args.frame = 0;
+
+	std::vector<float> output(input.size());
+	auto start = std::chrono::steady_clock::now();
+	for (size_t n = 0; n < input.size(); n++) {
+		module->inputs[kInInput].setVoltage(input[n]);
+		module->inputs[kFmInput].setVoltage(fm[n]);
+		module->process(args);
+		output[n] = module->outputs[kOutOutput].getVoltage();
+		args.frame++;
+	}
+	auto end = std::chrono::steady_clock::now();
+	ns += std::chrono::duration<double, std::nano>(end - start).count();
+	return output;
+}
+
+int main() {
+	// as the engine's threads do
+	_mm_setcsr(_mm_getcsr() | 0x8040);
+	random::init();
+
+	std::printf("%-8s %-22s %10s %14s %14s %14s\n", "rate", "case", "error (dB)", "max err (dB)",
+	            "full ns/smp", "adaptive ns/smp");
+
+	for (float sampleRate : kSampleRates) {
+		for (const Case& c : kCases) {
+			const int settleSamples = kSettleTime * sampleRate;
+			const int numSamples = settleSamples + kRunTime * sampleRate;
+			std::vector<float> input(numSamples), fm(numSamples);
+			for (int n = 0; n < numSamples; n++) {
+				const float t = n / sampleRate;
+				const float t1 = t - std::floor(t);
+				const bool loud = c.levelSteps && t1 > 0.4f && t1 < 0.6f;
+				// uniform noise, so the peaks are bounded by the level
+				input[n] = (loud ? 2.5f : 1.f) * c.level * (2.f * random::uniform() - 1.f);
+				fm[n] = c.fmDepth * std::sin(2.f * M_PI * 220.f * t);
+			}
+
+			double fullNs = 0., adaptiveNs = 0.;
+			Module* full = CreateAtlas("{\"adaptiveFidelity\": false}", sampleRate, c);
+			Module* adaptive = CreateAtlas("{\"adaptiveFidelity\": true}", sampleRate, c);
+			const std::vector<float> reference = Run(full, input, fm, sampleRate, fullNs);
+			const std::vector<float> output = Run(adaptive, input, fm, sampleRate, adaptiveNs);
+			delete full;
+			delete adaptive;
+
+			const int windowSamples = kWindowTime * sampleRate;
+			double signal = 0., error = 0., window = 0., maxWindow = 0.;
+			for (int n = settleSamples; n < numSamples; n++) {
+				const double difference = output[n] - reference[n];
+				signal += reference[n] * reference[n];
+				error += difference * difference;
+				window += difference * difference;
+				if ((n - settleSamples) % windowSamples == windowSamples - 1) {
+					maxWindow = std::max(maxWindow, window / windowSamples);
+					window = 0.;
+				}
+			}
+			const double signalMean = signal / (numSamples - settleSamples);
+
+			std::printf("%-8.0f %-22s %10.1f %14.1f %14.1f %14.1f\n", sampleRate, c.name,
+			            10. * std::log10(error / signal + 1e-30), 10. * std::log10(maxWindow / signalMean + 1e-30),
+			            fullNs / numSamples, adaptiveNs / numSamples);
+		}
+	}
+
+	return 0;
+}
@@ -0,0 +1,76 @@
+// Accuracy and cost of the crossfade law lookup table.
+//
+// Reports:
+//  * max error: worst-case absolute gain difference between gainsForChannels()
+//    and crossfadeLaw() over a dense sweep of route values, for one voice and
+//    for four (the bound quoted in plugin.hpp)
+//  * the gains for a NaN route value, which should be those for 0
+//  * ns/call: mean cost of crossfadeLaw(), gainsForChannels() and the
+//    four-voice gainsForChannels() (per four voices)
+
+#include <chrono>
+#include <cstdio>
+#include "plugin.hpp"
+
+static const int kNumSweepPoints = 1000000;
+static const int kNumCalls = 10000000;
+
+template <typename F>
+static double MeasureNsPerCall(F f) {
+	float_4 sink = 0.f;
+	auto start = std::chrono::steady_clock::now();
+	for (int n = 0; n < kNumCalls; n++) {
+		// a slowly moving route value, as from a slider or CV
+		sink += f((n & 0xffff) / 65535.f);
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	// keep the results alive
+	if (sink[0] == 1234.5f) {
+		std::printf(" ");
+	}
+	return std::chrono::duration<double, std::nano>(end - start).count() / kNumCalls;
+}
+
+int main() {
+	initCrossfadeTable();
+
+	double maxError = 0.0, maxVoicesError = 0.0;
+	for (int n = 0; n <= kNumSweepPoints; n++) {
+		const float routeValue = (float) n / kNumSweepPoints;
+		const float_4 exact = crossfadeLaw(routeValue);
+		const float_4 error = simd::abs(gainsForChannels(routeValue) - exact);
+		maxError = std::max(maxError, (double) horizontalMax(error));
+
+		float_4 channelGains[4];
+		gainsForChannels(float_4(routeValue), channelGains);
+		const float_4 voicesError = simd::abs(float_4(channelGains[0][0], channelGains[1][0], channelGains[2][0], channelGains[3][0]) - exact);
+		maxVoicesError = std::max(maxVoicesError, (double) horizontalMax(voicesError));
+	}
+	std::printf("table size %d, max error %.3g, four voices max error %.3g\n", CrossfadeTable::size, maxError, maxVoicesError);
+
+	float_4 nanGains[4];
+	gainsForChannels(float_4(NAN), nanGains);
+	const float_4 gainsForNan = gainsForChannels(NAN);
+	const float_4 gainsForZero = gainsForChannels(0.f);
+	std::printf("gains for NaN: %g %g %g %g, four voices: %g %g %g %g, for 0: %g %g %g %g\n\n",
+	            gainsForNan[0], gainsForNan[1], gainsForNan[2], gainsForNan[3],
+	            nanGains[0][0], nanGains[1][0], nanGains[2][0], nanGains[3][0],
+	            gainsForZero[0], gainsForZero[1], gainsForZero[2], gainsForZero[3]);
+
+	std::printf("ns/call  crossfadeLaw  gainsForChannels  gainsForChannels (4 voices)\n");
+	const double exact = MeasureNsPerCall([](float r) {
+		return crossfadeLaw(r);
+	});
+	const double table = MeasureNsPerCall([](float r) {
+		return gainsForChannels(r);
+	});
+	const double voices = MeasureNsPerCall([](float r) {
+		float_4 channelGains[4];
+		gainsForChannels(float_4(r, 1.f - r, 0.5f * r, 0.5f + 0.5f * r), channelGains);
+		return channelGains[0] + channelGains[1] + channelGains[2] + channelGains[3];
+	});
+	std::printf("         %12.2f  %16.2f  %27.2f\n", exact, table, voices);
+
+	return 0;
+}
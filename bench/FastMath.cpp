@@ -0,0 +1,97 @@
+// Accuracy and cost of the approximations in FastMath.hpp.
+//
+// Reports, for each function and for float and float_4:
+//  * max error: worst-case error against the standard library over a dense sweep of its range,
+//    and the bound quoted in FastMath.hpp. Relative for fastExp2 and fastSqrt, absolute for the
+//    others, but relative where the result is over 1 (as float rounding is).
+//  * ns/value: mean cost of the approximation and of the function it replaces
+// Exits with an error if any bound is exceeded, so that `make bench` fails.
+
+#include <chrono>
+#include <cstdio>
+#include "plugin.hpp"
+#include "FastMath.hpp"
+
+static const int kNumSweepPoints = 1000000;
+static const int kNumCalls = 10000000;
+
+struct Check {
+	const char* name;
+	float lo, hi;
+	bool relative;
+	double bound;
+	double (*exact)(double);
+	float (*fast)(float);
+	float_4 (*fast4)(float_4);
+};
+
+static double FirstLane(float x) {
+	return x;
+}
+
+static double FirstLane(float_4 x) {
+	return x[0];
+}
+
+template <typename T, typename F>
+static double MeasureNsPerValue(F f, float lo, float hi) {
+	T sink = 0.f;
+	auto start = std::chrono::steady_clock::now();
+	for (int n = 0; n < kNumCalls; n++) {
+		sink += f(T(lo + (hi - lo) * (n & 0xffff) / 65535.f));
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	// keep the results alive
+	if (FirstLane(sink) == 1234.5) {
+		std::printf(" ");
+	}
+	const int lanes = sizeof(T) / sizeof(float);
+	return std::chrono::duration<double, std::nano>(end - start).count() / kNumCalls / lanes;
+}
+
+template <typename F, typename G>
+static void PrintTimes(const char* name, float lo, float hi, F fast, G reference) {
+	std::printf("%-9s %6.2f  %6.2f      %6.2f  %6.2f\n", name,
+	            MeasureNsPerValue<float>(fast, lo, hi), MeasureNsPerValue<float>(reference, lo, hi),
+	            MeasureNsPerValue<float_4>(fast, lo, hi), MeasureNsPerValue<float_4>(reference, lo, hi));
+}
+
+int main() {
+	const Check checks[] = {
+		{"fastExp2", -126.f, 126.f, true, 2e-7, [](double x) { return std::exp2(x); },
+		 [](float x) { return fastExp2(x); }, [](float_4 x) { return fastExp2(x); }},
+		{"fastLog2", 1e-30f, 1e30f, false, 5e-7, [](double x) { return std::log2(x); },
+		 [](float x) { return fastLog2(x); }, [](float_4 x) { return fastLog2(x); }},
+		{"fastTanh", -10.f, 10.f, false, 1.1e-2, [](double x) { return std::tanh(x); },
+		 [](float x) { return fastTanh(x); }, [](float_4 x) { return fastTanh(x); }},
+		{"fastSqrt", 0.f, 100.f, true, 6e-8, [](double x) { return std::sqrt(x); },
+		 [](float x) { return fastSqrt(x); }, [](float_4 x) { return fastSqrt(x); }},
+	};
+
+	bool passed = true;
+	std::printf("function  max error (float)  max error (float_4)  bound\n");
+	for (const Check& check : checks) {
+		double maxError = 0.0, maxError4 = 0.0;
+		for (int n = 0; n <= kNumSweepPoints; n++) {
+			// log2 is swept geometrically
+			const double t = (double) n / kNumSweepPoints;
+			const float x = check.lo > 0.f ? check.lo * std::pow((double) check.hi / check.lo, t) : check.lo + (check.hi - check.lo) * t;
+			const double exact = check.exact(x);
+			const double scale = check.relative ? std::max(std::abs(exact), 1e-30) : std::max(std::abs(exact), 1.0);
+			maxError = std::max(maxError, std::abs(check.fast(x) - exact) / scale);
+			maxError4 = std::max(maxError4, std::abs(check.fast4(float_4(x))[n % 4] - exact) / scale);
+		}
+		const bool ok = maxError <= check.bound && maxError4 <= check.bound;
+		passed = passed && ok;
+		std::printf("%-9s %17.3g  %19.3g  %.2g%s\n", check.name, maxError, maxError4, check.bound, ok ? "" : "  EXCEEDS BOUND");
+	}
+
+	std::printf("\nns/value  float   (std)       float_4 (simd)\n");
+	PrintTimes("fastExp2", -10.f, 10.f, [](auto x) { return fastExp2(x); }, [](auto x) { return simd::pow(2.f, x); });
+	PrintTimes("fastLog2", 0.01f, 100.f, [](auto x) { return fastLog2(x); }, [](auto x) { return simd::log2(x); });
+	PrintTimes("fastTanh", -5.f, 5.f, [](auto x) { return fastTanh(x); }, [](auto x) { return simd::tanh(x); });
+	PrintTimes("fastSqrt", 0.f, 100.f, [](auto x) { return fastSqrt(x); }, [](auto x) { return simd::sqrt(x); });
+
+	return passed ? 0 : 1;
+}
@@ -0,0 +1,84 @@
+// Cost and agreement of the kernel variants in src/kernels/.
+//
+// Reports, for Hive's panStrips() with every strip carrying 1, 4, 8 and 16 voices:
+//  * ns/call of each variant this CPU supports (all four strips)
+//  * whether its sums are bit-identical to the SSE kernel's, which every variant should be (see
+//    src/kernels/Kernels.hpp), and if not their max difference relative to their size
+// and which variant initKernels() picked.
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "plugin.hpp"
+#include "kernels/Kernels.hpp"
+
+static const int kNumCalls = 2000000;
+
+struct StripData {
+	float left[16], right[16], panCv[16];
+};
+
+static double MeasureNsPerCall(const Kernels& variant, const StripVoices strips[4]) {
+	float sink = 0.f;
+	float leftSums[4], rightSums[4];
+	auto start = std::chrono::steady_clock::now();
+	for (int n = 0; n < kNumCalls; n++) {
+		variant.panStrips(strips, leftSums, rightSums);
+		sink += leftSums[n & 3] + rightSums[n & 3];
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	// keep the results alive
+	if (sink == 1234.5f) {
+		std::printf(" ");
+	}
+	return std::chrono::duration<double, std::nano>(end - start).count() / kNumCalls;
+}
+
+int main() {
+	initKernels();
+	std::printf("initKernels() picked %s\n\n", kernels->name);
+
+	std::vector<const Kernels*> variants = {&kernelsSSE};
+#if defined(__x86_64__) || defined(_M_X64)
+	if (kernelsAVX2 && __builtin_cpu_supports("avx2")) {
+		variants.push_back(kernelsAVX2);
+	}
+#endif
+
+	StripData data[4];
+	for (int i = 0; i < 4; i++) {
+		for (int c = 0; c < 16; c++) {
+			data[i].left[c] = 10.f * random::uniform() - 5.f;
+			data[i].right[c] = 10.f * random::uniform() - 5.f;
+			data[i].panCv[c] = 6.f * random::uniform() - 3.f;
+		}
+	}
+
+	std::printf("voices  variant  ns/call  identical  max difference\n");
+	for (int voices : {1, 4, 8, 16}) {
+		StripVoices strips[4];
+		for (int i = 0; i < 4; i++) {
+			strips[i] = {data[i].left, data[i].right, data[i].panCv, voices, voices, voices == 1, 0.25f * i - 0.5f, 1.f};
+		}
+
+		float referenceLeft[4], referenceRight[4];
+		kernelsSSE.panStrips(strips, referenceLeft, referenceRight);
+		for (const Kernels* variant : variants) {
+			float leftSums[4], rightSums[4];
+			variant->panStrips(strips, leftSums, rightSums);
+			float maxDifference = 0.f;
+			for (int i = 0; i < 4; i++) {
+				maxDifference = std::max(maxDifference, std::abs(leftSums[i] - referenceLeft[i]) / std::max(1.f, std::abs(referenceLeft[i])));
+				maxDifference = std::max(maxDifference, std::abs(rightSums[i] - referenceRight[i]) / std::max(1.f, std::abs(referenceRight[i])));
+			}
+			const bool identical = std::memcmp(leftSums, referenceLeft, sizeof(leftSums)) == 0 &&
+			                       std::memcmp(rightSums, referenceRight, sizeof(rightSums)) == 0;
+			std::printf("%6d  %-7s  %7.2f  %-9s  %.3g\n", voices, variant->name, MeasureNsPerCall(*variant, strips),
+			            identical ? "yes" : "no", maxDifference);
+		}
+	}
+
+	return 0;
+}
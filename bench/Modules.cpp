@@ -0,0 +1,213 @@
+// Cost of every module, in ns per sample, run without Rack.
+//
+// Plays the engine itself: creates each module from its Model, sends it an AddEvent and a
+// SampleRateChangeEvent, patches every port and calls process() with synthetic inputs (slow sines
+// that cross the gate thresholds, plus an audio-rate sine on top), in blocks of kBlockSize
+// samples. Each module runs for every combination of its settings that affects its cost (what its
+// context menu stores in dataToJson()), voice counts and sample rates, with the panel at its
+// defaults. Reports, as a JSON array on stdout:
+//  * meanNs: total time over total samples
+//  * p99Ns, maxNs: 99th percentile and worst of the per-block averages
+// so results can be saved with `./build/bench/Modules > modules.json` and compared across changes.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+#include <xmmintrin.h>
+#include "plugin.hpp"
+#include "kernels/Kernels.hpp"
+
+static const int kBlockSize = 32;
+static const float kWarmupTime = 0.1f;
+static const float kRunTime = 2.f;
+static const float kSampleRates[] = {44100.f, 48000.f, 96000.f};
+
+static const int kSineTableSize = 4096;
+
+struct ModuleConfigs {
+	Model* model;
+	// settings, as dataFromJson() reads them
+	std::vector<std::string> data;
+	std::vector<int> channels;
+};
+
+struct Stats {
+	double meanNs;
+	double p99Ns;
+	double maxNs;
+};
+
+// per voice phase accumulators, wrapping at 2^32
+struct InputSignals {
+	std::vector<float> sineTable;
+	std::vector<uint32_t> slowPhases, slowSteps, fastPhases, fastSteps;
+
+	InputSignals(int numInputs, float sampleRate) : sineTable(kSineTableSize) {
+		for (int n = 0; n < kSineTableSize; n++) {
+			sineTable[n] = std::sin(2 * M_PI * n / kSineTableSize);
+		}
+		for (int i = 0; i < numInputs; i++) {
+			for (int c = 0; c < PORT_MAX_CHANNELS; c++) {
+				const double spread = 1. + c / 16.;
+				slowPhases.push_back(0);
+				slowSteps.push_back(std::ldexp(1.5 * (i + 1) * spread / sampleRate, 32));
+				fastPhases.push_back(0);
+				fastSteps.push_back(std::ldexp(110. * (1 + i % 7) * spread / sampleRate, 32));
+			}
+		}
+	}
+
+	float next(int i, int c) {
+		const int k = i * PORT_MAX_CHANNELS + c;
+		slowPhases[k] += slowSteps[k];
+		fastPhases[k] += fastSteps[k];
+		return 4.f * sineTable[slowPhases[k] >> 20] + sineTable[fastPhases[k] >> 20];
+	}
+};
+
+// every combination of the settings' values, as dataFromJson() reads them
+static std::vector<std::string> Combinations(const std::vector<std::pair<const char*, std::vector<const char*>>>& settings) {
+	std::vector<std::string> data = {""};
+	for (const auto& setting : settings) {
+		std::vector<std::string> combined;
+		for (const std::string& others : data) {
+			for (const char* value : setting.second) {
+				combined.push_back(others + (others.empty() ? "" : ", ") + "\"" + setting.first + "\": " + value);
+			}
+		}
+		data = combined;
+	}
+	for (std::string& d : data) {
+		d = "{" + d + "}";
+	}
+	return data;
+}
+
+static Stats Measure(Model* model, const char* data, int channels, float sampleRate) {
+	Module* module = model->createModule();
+
+	json_t* dataJ = json_loads(data, 0, nullptr);
+	module->dataFromJson(dataJ);
+	json_decref(dataJ);
+
+	// as the engine does when it adds the module, which starts Atlas's worker threads
+	Module::AddEvent addEvent;
+	module->onAdd(addEvent);
+
+	Module::SampleRateChangeEvent e;
+	e.sampleRate = sampleRate;
+	e.sampleTime = 1.f / sampleRate;
+	module->onSampleRateChange(e);
+
+	// as the engine does when cables are added (setChannels() leaves unpatched ports alone)
+	for (Input& input : module->inputs) {
+		input.channels = channels;
+	}
+	for (Output& output : module->outputs) {
+		output.channels = 1;
+	}
+
+	const int numInputs = module->inputs.size();
+	InputSignals signals(numInputs, sampleRate);
+	std::vector<float> block(kBlockSize * numInputs * channels);
+
+	Module::ProcessArgs args;
+	args.sampleRate = sampleRate;
+	args.sampleTime = 1.f / sampleRate;
+	args.frame = 0;
+
+	const int warmupBlocks = kWarmupTime * sampleRate / kBlockSize;
+	const int numBlocks = kRunTime * sampleRate / kBlockSize;
+	std::vector<double> blockNs;
+	double totalNs = 0.;
+	for (int b = 0; b < warmupBlocks + numBlocks; b++) {
+		// inputs are generated outside the timed loop, which only copies them as cables would
+		for (int n = 0; n < kBlockSize; n++) {
+			for (int i = 0; i < numInputs; i++) {
+				for (int c = 0; c < channels; c++) {
+					block[(n * numInputs + i) * channels + c] = signals.next(i, c);
+				}
+			}
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		for (int n = 0; n < kBlockSize; n++) {
+			for (int i = 0; i < numInputs; i++) {
+				module->inputs[i].setVoltages(&block[(n * numInputs + i) * channels]);
+			}
+			module->process(args);
+			args.frame++;
+		}
+		auto end = std::chrono::steady_clock::now();
+
+		if (b >= warmupBlocks) {
+			const double ns = std::chrono::duration<double, std::nano>(end - start).count();
+			blockNs.push_back(ns / kBlockSize);
+			totalNs += ns;
+		}
+	}
+
+	delete module;
+
+	std::sort(blockNs.begin(), blockNs.end());
+	const int p99 = std::max(0, (int) std::ceil(0.99 * blockNs.size()) - 1);
+	return {totalNs / (numBlocks * kBlockSize), blockNs[p99], blockNs.back()};
+}
+
+int main() {
+	// as the engine's threads do
+	_mm_setcsr(_mm_getcsr() | 0x8040);
+	random::init();
+	initKernels();
+	initCrossfadeTable();
+
+	const std::vector<int> poly = {1, 4, 16};
+	const std::vector<ModuleConfigs> modules = {
+		{modelPath, {"{\"antialiasRoute\": false}", "{\"antialiasRoute\": true}"}, poly},
+		{modelTrace, {"{\"antialiasScan\": false}", "{\"antialiasScan\": true}"}, poly},
+		{modelAsset, {"{}"}, poly},
+		// adaptiveFidelity is spelled out as false, so results stay comparable if its default changes
+		{modelAtlas, Combinations({
+				{"filterSimulationType", {"0", "1"}},
+				{"adaptiveFidelity", {"false", "true"}},
+				{"workerThreads", {"false", "true"}},
+				{"polyOutputs", {"false", "true"}},
+				{"antialiasClipping", {"false", "true"}},
+			}), {1}
+		},
+		{modelCeres, {"{\"antialiasClipping\": false}", "{\"antialiasClipping\": true}"}, poly},
+		{modelFuji, {"{}"}, poly},
+		{modelSena, {
+				"{\"oversamplingIndex\": 0, \"useAdaa\": false}", "{\"oversamplingIndex\": 0, \"useAdaa\": true}",
+				"{\"oversamplingIndex\": 1, \"useAdaa\": false}", "{\"oversamplingIndex\": 1, \"useAdaa\": true}",
+				"{\"oversamplingIndex\": 2, \"useAdaa\": false}", "{\"oversamplingIndex\": 2, \"useAdaa\": true}",
+				"{\"oversamplingIndex\": 3, \"useAdaa\": false}", "{\"oversamplingIndex\": 3, \"useAdaa\": true}",
+			}, {1}
+		},
+		{modelHive, {"{\"antialiasClipping\": false}", "{\"antialiasClipping\": true}"}, poly},
+	};
+
+	std::printf("[");
+	const char* separator = "\n";
+	for (const ModuleConfigs& configs : modules) {
+		for (const std::string& data : configs.data) {
+			for (int channels : configs.channels) {
+				for (float sampleRate : kSampleRates) {
+					const Stats stats = Measure(configs.model, data.c_str(), channels, sampleRate);
+					std::printf("%s\t{\"module\": \"%s\", \"data\": %s, \"channels\": %d, \"sampleRate\": %g, "
+					            "\"meanNs\": %.2f, \"p99Ns\": %.2f, \"maxNs\": %.2f}",
+					            separator, configs.model->slug.c_str(), data.c_str(), channels, sampleRate,
+					            stats.meanNs, stats.p99Ns, stats.maxNs);
+					separator = ",\n";
+				}
+			}
+		}
+	}
+	std::printf("\n]\n");
+
+	return 0;
+}
@@ -0,0 +1,153 @@
+// Cost and accuracy of the RipplesEngine ODE solvers.
+//
+// For each host sample rate and solver this reports:
+//  * ns/sample: mean cost of RipplesEngine::process() on a noise input
+//  * response error: worst-case deviation (dB) of the LP4 magnitude response
+//    at a handful of test frequencies
+//  * pitch error: deviation (cents) of the self-oscillation frequency
+// Errors are measured against RK4 running at kReferenceSampleRate, where the
+// engine does not oversample and the step size is smallest.
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "plugin.hpp"
+#include "ripples.hpp"
+
+using ripples::RipplesEngine;
+
+static const float kReferenceSampleRate = 768000.f;
+static const float kCutoff = 1000.f;
+static const float kTestFreqs[] = {100.f, 500.f, 1000.f, 2000.f, 5000.f, 10000.f};
+static const char* kSolverNames[] = {"euler", "rk2", "rk4", "trapezoidal"};
+
+static float FreqKnobForCutoff(float cutoff) {
+	return 1.f + std::log2(cutoff / ripples::kFreqKnobMax) / ripples::kFreqKnobVoltage;
+}
+
+static RipplesEngine::Frame MakeFrame(float res_knob) {
+	RipplesEngine::Frame frame;
+	frame.res_knob = res_knob;
+	frame.freq_knob = FreqKnobForCutoff(kCutoff);
+	frame.clipOutputs = false;
+	return frame;
+}
+
+static double MeasureNsPerSample(RipplesEngine::Solver solver, float sampleRate) {
+	RipplesEngine engine;
+	engine.setSolver(solver);
+	engine.setSampleRate(sampleRate);
+	RipplesEngine::Frame frame = MakeFrame(0.5f);
+
+	const int numSamples = (int) sampleRate * 2;
+	std::vector<float> noise(numSamples);
+	for (float& x : noise) {
+		x = 5.f * random::normal();
+	}
+
+	float sink = 0.f;
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < numSamples; i++) {
+		frame.input = noise[i];
+		engine.process(frame);
+		sink += frame.lp4;
+	}
+	auto end = std::chrono::steady_clock::now();
+
+	// keep the optimiser honest
+	if (sink == 1234.5f) {
+		std::printf(" ");
+	}
+	return std::chrono::duration<double, std::nano>(end - start).count() / numSamples;
+}
+
+// LP4 gain in dB for a small sine at `freq`, measured after the filter settles
+static float MeasureGainDb(RipplesEngine::Solver solver, float sampleRate, float freq) {
+	RipplesEngine engine;
+	engine.setSolver(solver);
+	engine.setSampleRate(sampleRate);
+	RipplesEngine::Frame frame = MakeFrame(0.5f);
+
+	const float amplitude = 0.1f;
+	const int settleSamples = (int)(0.2f * sampleRate);
+	const int measureSamples = (int)(0.2f * sampleRate);
+	double sumIn = 0.0, sumOut = 0.0;
+	for (int i = 0; i < settleSamples + measureSamples; i++) {
+		frame.input = amplitude * std::sin(2.0 * M_PI * freq * i / sampleRate);
+		engine.process(frame);
+		if (i >= settleSamples) {
+			sumIn += frame.input * frame.input;
+			sumOut += frame.lp4 * frame.lp4;
+		}
+	}
+	return 10.f * std::log10(sumOut / sumIn);
+}
+
+// Self-oscillation frequency in Hz, from interpolated zero crossings
+static float MeasureOscillationHz(RipplesEngine::Solver solver, float sampleRate) {
+	RipplesEngine engine;
+	engine.setSolver(solver);
+	engine.setSampleRate(sampleRate);
+	RipplesEngine::Frame frame = MakeFrame(1.f);
+
+	const int settleSamples = (int)(1.f * sampleRate);
+	const int measureSamples = (int)(0.5f * sampleRate);
+	float last = 0.f;
+	double firstCrossing = -1.0, lastCrossing = -1.0;
+	int crossings = 0;
+	for (int i = 0; i < settleSamples + measureSamples; i++) {
+		engine.process(frame);
+		if (i >= settleSamples && last < 0.f && frame.lp4 >= 0.f) {
+			double t = i - 1 + last / (last - frame.lp4);
+			if (firstCrossing < 0.0) {
+				firstCrossing = t;
+			}
+			lastCrossing = t;
+			crossings++;
+		}
+		last = frame.lp4;
+	}
+
+	if (crossings < 2) {
+		return 0.f;
+	}
+	return (crossings - 1) * sampleRate / (lastCrossing - firstCrossing);
+}
+
+int main() {
+	random::init();
+
+	std::vector<float> referenceGains;
+	for (float freq : kTestFreqs) {
+		referenceGains.push_back(MeasureGainDb(RipplesEngine::SOLVER_RK4, kReferenceSampleRate, freq));
+	}
+	const float referencePitch = MeasureOscillationHz(RipplesEngine::SOLVER_RK4, kReferenceSampleRate);
+
+	std::printf("reference: RK4 at %.0f Hz, self-oscillation at %.2f Hz\n\n", kReferenceSampleRate, referencePitch);
+	std::printf("%-8s %-4s %-12s %10s %18s %16s\n", "rate", "os", "solver", "ns/sample", "response err (dB)", "pitch err (ct)");
+
+	for (float sampleRate : {44100.f, 48000.f, 96000.f}) {
+		ripples::AAFilter<float> aaFilter;
+		aaFilter.Init(sampleRate);
+
+		for (int s = 0; s < RipplesEngine::NUM_SOLVERS; s++) {
+			auto solver = static_cast<RipplesEngine::Solver>(s);
+
+			const double nsPerSample = MeasureNsPerSample(solver, sampleRate);
+
+			float responseError = 0.f;
+			for (size_t f = 0; f < referenceGains.size(); f++) {
+				const float gain = MeasureGainDb(solver, sampleRate, kTestFreqs[f]);
+				responseError = std::max(responseError, std::abs(gain - referenceGains[f]));
+			}
+
+			const float pitch = MeasureOscillationHz(solver, sampleRate);
+			const float pitchError = (pitch > 0.f && referencePitch > 0.f) ? 1200.f * std::log2(pitch / referencePitch) : NAN;
+
+			std::printf("%-8.0f x%-3d %-12s %10.1f %18.3f %16.2f\n", sampleRate, aaFilter.GetOversamplingFactor(),
+			            kSolverNames[s], nsPerSample, responseError, pitchError);
+		}
+	}
+
+	return 0;
+}
@@ -28,6 +28,8 @@ struct Asset : Module {
 	bool clipOutput = true;
 
 	dsp::ClockDivider lightDivider;
+	// channels 1-4 and 5-6
+	PeakAccumulator outputLevels[2];
 
 	Asset() {
 		config(PARAMS_LEN, INPUTS_LEN, OUTPUTS_LEN, LIGHTS_LEN);
@@ -48,7 +50,12 @@ struct Asset : Module {
 		const bool doUpdate = lightDivider.process();
 		const float sampleTime = args.sampleTime * lightUpdateRate;
 
-		float normalVoltage = 0.f;
+		// unpatched inputs are normalled to the previous channel, voice by voice
+		float_4 normalVoltages[4] = {0.f, 0.f, 0.f, 0.f};
+		int normalChannels = 1;
+		// highest and lowest voice of each channel, for the LEDs
+		float_4 maxOuts[2] = {0.f, 0.f};
+		float_4 minOuts[2] = {0.f, 0.f};
 		for (int i = 0; i < NUM_CHANNELS; i++) {
 
 			const float inputPolarity = params[INPUT_POLARITY1_PARAM + i].getValue() ? -1.f : +1.f;
@@ -57,22 +64,50 @@ struct Asset : Module {
 			gains[i]->displayMultiplier = inputPolarity;
 			offsets[i]->displayMultiplier = offsetPolarity;
 
-			float level = params[LEVEL1_PARAM + i].getValue() * inputPolarity;
-			float offset = params[OFFSET1_PARAM + i].getValue() * offsetPolarity;
-			float in = inputs[IN1_INPUT + i].getNormalVoltage(normalVoltage);
-			normalVoltage = in;
-
-			float out = (in * level) + offset;
-			if (clipOutput) {
-				out = clamp(out, -10.f, +10.f);
+			const float level = params[LEVEL1_PARAM + i].getValue() * inputPolarity;
+			const float offset = params[OFFSET1_PARAM + i].getValue() * offsetPolarity;
+			Input& in = inputs[IN1_INPUT + i];
+			const int channels = in.isConnected() ? in.getChannels() : normalChannels;
+
+			float_4 maxOut = -INFINITY;
+			float_4 minOut = INFINITY;
+			for (int c = 0; c < channels; c += 4) {
+				if (in.isConnected()) {
+					normalVoltages[c / 4] = getVoicesSimd(in, c);
+				}
+
+				float_4 out = (normalVoltages[c / 4] * level) + offset;
+				if (clipOutput) {
+					out = simd::clamp(out, -10.f, +10.f);
+				}
+				outputs[OUT1_OUTPUT + i].setVoltageSimd(out, c);
+
+				const float_4 mask = voiceMask(c, channels);
+				maxOut = simd::fmax(maxOut, simd::ifelse(mask, out, -INFINITY));
+				minOut = simd::fmin(minOut, simd::ifelse(mask, out, INFINITY));
 			}
-			outputs[OUT1_OUTPUT + i].setVoltage(out);
+			outputs[OUT1_OUTPUT + i].setChannels(channels);
+			normalChannels = channels;
+
+			maxOuts[i / 4][i % 4] = horizontalMax(maxOut);
+			minOuts[i / 4][i % 4] = horizontalMin(minOut);
+		}
 
-			if (doUpdate) {
+		// the accumulators' max then tracks the highest voice, and min the lowest
+		for (int k = 0; k < 2; k++) {
+			outputLevels[k].process(maxOuts[k]);
+			outputLevels[k].process(minOuts[k]);
+		}
+		if (doUpdate) {
+			for (int i = 0; i < NUM_CHANNELS; i++) {
 				// orange for positive, blue for negative
-				lights[NUM1_LIGHT + 2 * i + 0].setBrightnessSmooth(out > 0.f ? +out / 5.f : 0.f, sampleTime, lambda);
-				lights[NUM1_LIGHT + 2 * i + 1].setBrightnessSmooth(out < 0.f ? -out / 5.f : 0.f, sampleTime, lambda);
+				const float maxOut = outputLevels[i / 4].max[i % 4];
+				const float minOut = outputLevels[i / 4].min[i % 4];
+				lights[NUM1_LIGHT + 2 * i + 0].setBrightnessSmooth(maxOut > 0.f ? +maxOut / 5.f : 0.f, sampleTime, lambda);
+				lights[NUM1_LIGHT + 2 * i + 1].setBrightnessSmooth(minOut < 0.f ? -minOut / 5.f : 0.f, sampleTime, lambda);
 			}
+			outputLevels[0].reset();
+			outputLevels[1].reset();
 		}
 	}
 
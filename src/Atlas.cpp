@@ -1,5 +1,6 @@
 #include "plugin.hpp"
 #include "ripples.hpp"
+#include "WorkerPool.hpp"
 
 struct Atlas : Module {
 	static const int NUM_CHANNELS = 4;
@@ -39,17 +40,162 @@ struct Atlas : Module {
 	};
 
 	ripples::RipplesEngine engines[NUM_CHANNELS];
+	ripples::RipplesZDFEngine zdfEngines[NUM_CHANNELS];
+	ripples::RipplesLinearEngine linearEngines[NUM_CHANNELS];
+	// engine sample rate, as of the last reset
+	float sampleRate = 44100.f;
+	// runtime anti-aliasing design for sampleRate if the engine has no table for it, requested in
+	// onSampleRateChange() as that may take a lock and start the design thread
+	const ripples::AAFilterCache::Entry* antialiasingDesign = nullptr;
 	dsp::ClockDivider lightDivider;
+	PeakAccumulator inputLevels;
 	bool compensate = true;
 	bool addLowend = true;
 	bool clipOutput = true;
+	// for the circuit-based model, opt-in as it costs half a sample of delay and some top end
+	bool antialiasClipping = false;
+	// output LP, HP and BP together as channels 1-3 of each channel's output
+	bool polyOutputs = false;
 
-	// not currently used, but future-proofing in case we improve the filter model
+	// HEURISTIC is the oversampled ODE model, CIRCUIT_BASED a zero-delay-feedback model that runs at 1x
 	enum FilterSimulationType {
-		HEURISTIC, 
+		HEURISTIC,
 		CIRCUIT_BASED
 	};
-	FilterSimulationType filterSimulationType = HEURISTIC;
+	// atomic, as the menu sets this while process() reads it
+	std::atomic<FilterSimulationType> filterSimulationType{HEURISTIC};
+	// engine that last processed audio, the other is reset before switching over
+	FilterSimulationType activeFilterSimulationType = HEURISTIC;
+
+	// Engines sleep while neither their own output nor the scan output is patched, or once
+	// input and output have been silent for a while with resonance too low to self-oscillate
+	enum EngineState {
+		AWAKE,
+		SLEEPING_SILENT,
+		SLEEPING_UNPATCHED
+	};
+	EngineState engineStates[NUM_CHANNELS] = {};
+	int silentSamples[NUM_CHANNELS] = {};
+	float outputLevels[NUM_CHANNELS] = {};
+	int silentSamplesBeforeSleep = 0;
+	const float silenceThreshold = 1e-4f;
+	const float silenceTime = 0.2f;
+	// keep a margin below self-oscillation so that long resonant tails are left to ring out
+	const float maxSleepingLoopGain = 0.9f * ripples::kSelfOscillationLoopGain;
+
+	// Adaptive fidelity: at low level, resonance and cutoff, and without audio-rate FM, the heuristic
+	// engine is effectively linear, so a linear model at 1x stands in for it. Its output is delayed to
+	// line up with the engine's anti-aliasing filters, after which the two differ by -30 dB or less
+	// below these thresholds (see bench/AdaptiveFidelity.cpp).
+	std::atomic<bool> adaptiveFidelity{false};
+	const float linearMaxEnvelope = 2.f;
+	const float linearMaxLoopGain = 0.5f;
+	// relative to the sample rate, the models drift apart in the top octaves
+	const float linearMaxCutoff = 0.02f;
+	// second difference of v_oct per sample, as RipplesEngine's audio-rate detection
+	const float linearMaxFmCurvature = 2.5e-5f;
+	// hysteresis, above these the full model is brought back at once
+	const float fullMinEnvelope = 2.5f;
+	const float fullMinLoopGain = 0.75f;
+	const float fullMinCutoff = 0.025f;
+	const float envelopeReleaseTime = 0.05f;
+	const float linearHoldTime = 0.1f;
+	const float fullWarmupTime = 1e-3f;
+	const float crossfadeTime = 5e-3f;
+	// longer than the engine's latency at any sample rate
+	static const int linearDelaySize = 16;
+	struct FidelityState {
+		// set with the sample rate by resetChannel(), on whichever thread runs the channel's engines
+		float envelopeDecay = 0.f;
+		// cutoff thresholds as v_oct
+		float linearMaxVOct = 0.f;
+		float fullMinVOct = 0.f;
+		int linearHoldSamples = 0;
+		int fullWarmupSamples = 0;
+		float crossfadeStep = 0.f;
+
+		float envelope = 0.f;
+		float vOctHistory[2] = {};
+		int linearSamples = 0;
+		int warmupSamples = 0;
+		// 0 = linear model only, 1 = full model only
+		float fullWeight = 1.f;
+		// whether the linear model ran on the last sample
+		bool linearActive = false;
+		// the linear model's last outputs (hp2, bp4, lp4, 0)
+		float_4 linearOutputs[linearDelaySize] = {};
+		int linearOutputIndex = 0;
+	};
+	FidelityState fidelityStates[NUM_CHANNELS];
+
+	// A runtime anti-aliasing design that becomes ready while an engine runs is switched in on a copy
+	// of the engine, which settles for fullWarmupTime and is then crossfaded in over crossfadeTime.
+	// Where the engine is silent, the design is switched in directly.
+	struct AntialiasingSwitch {
+		bool active = false;
+		int warmupSamples = 0;
+		// 0 = current engine only, 1 = switching engine only
+		float weight = 0.f;
+	};
+	AntialiasingSwitch antialiasingSwitches[NUM_CHANNELS];
+	ripples::RipplesEngine switchingEngines[NUM_CHANNELS];
+
+	// One frame of work for a channel's engines, and its result
+	struct ChannelJob {
+		ripples::RipplesEngine::Frame frame;
+		ripples::RipplesEngine::ProcessFunction processEngine;
+		// the menu options, as of this frame
+		FilterSimulationType filterSimulationType = HEURISTIC;
+		bool adaptiveFidelity = false;
+		EngineState engineState = SLEEPING_SILENT;
+		// wake from SLEEPING_UNPATCHED
+		bool resetEngines = false;
+		// if set, reset the engines to this sample rate and anti-aliasing design first, see reset()
+		float resetSampleRate = 0.f;
+		const ripples::AAFilterCache::Entry* resetAntialiasingDesign = nullptr;
+	};
+
+	// Optional worker threads. Each worker owns the engines of one of the last numWorkers channels,
+	// and process() keeps the others, so that it does its share of the DSP rather than running ahead
+	// of the workers within one of Rack's bursts. Every channel's jobs are collected into blocks of
+	// workerBlockSize frames. A filled block goes to its worker through a single-producer/single-
+	// consumer ring (or is processed by process() at once), and its results are read while the block
+	// after it fills: one block to fill, one of slack for the worker, so the latency is two blocks.
+	// process() never waits for a worker: if a block isn't back in time, its channel holds its last
+	// output for the block, the block counts in lateBlocks, and its results are dropped.
+	static const int workerBlockSize = 16;
+	static const int workerLatency = 2 * workerBlockSize;
+	static const int numWorkers = 2;
+	static const int firstWorkerChannel = NUM_CHANNELS - numWorkers;
+	static const int workerRingBlocks = 8;
+	struct ChannelBlock {
+		ChannelJob jobs[workerBlockSize];
+		// numbered as they're filled, so that late results can be told apart
+		uint32_t sequence = 0;
+	};
+	struct WorkerRings {
+		dsp::RingBuffer<ChannelBlock, workerRingBlocks> jobs;
+		dsp::RingBuffer<ChannelBlock, workerRingBlocks> results;
+	};
+	WorkerRings workerRings[numWorkers];
+	// per channel, the block being filled, the one being read, and the one that's next (process()'s
+	// own channels) or a result that came back ahead of its time (the workers' channels)
+	ChannelBlock fillingBlocks[NUM_CHANNELS];
+	ChannelBlock readingBlocks[NUM_CHANNELS];
+	ChannelBlock nextBlocks[NUM_CHANNELS];
+	bool nextBlockValid[NUM_CHANNELS] = {};
+	uint32_t blockSequence = 0;
+	uint32_t firstWorkerBlock = 0;
+	int blockPosition = 0;
+	// atomic, as the menu sets this while process() reads it
+	std::atomic<bool> workerThreads{false};
+	// whether the workers own their channels' engines, only changed by the engine thread
+	bool workersActive = false;
+	// blocks that weren't back in time since the workers started, shown in the menu
+	std::atomic<int> lateBlocks{0};
+	// per channel, a reset for the next job to carry to the engines, see reset()
+	float resetSampleRates[NUM_CHANNELS] = {};
+	WorkerPool workerPool;
 
 	Atlas() {
 		config(PARAMS_LEN, INPUTS_LEN, OUTPUTS_LEN, LIGHTS_LEN);
@@ -72,19 +218,366 @@ struct Atlas : Module {
 		lightDivider.setDivision(lightUpdateRate);
 	}
 
+	~Atlas() {
+		workerPool.stop();
+	}
+
+	// the engine adds modules from the UI thread, so the threads can start here
+	void onAdd(const AddEvent& e) override {
+		updateWorkerPool();
+	}
+
 	void onReset(const ResetEvent& e) override {
-		reset(APP->engine->getSampleRate());
+		reset(sampleRate);
 		Module::onReset(e);
 	}
 
 	void onSampleRateChange(const SampleRateChangeEvent& e) override {
+		antialiasingDesign = ripples::RipplesEngine::requestAntialiasing(e.sampleRate);
 		reset(e.sampleRate);
 	}
 
+	// Engines owned by a worker are reset by the next job, in order with the blocks in flight
 	void reset(float sampleRate) {
+		this->sampleRate = sampleRate;
 		for (int c = 0; c < NUM_CHANNELS; c++) {
-			engines[c].setSampleRate(sampleRate);
+			engineStates[c] = AWAKE;
+			silentSamples[c] = 0;
+			outputLevels[c] = 0.f;
+			if (workersActive) {
+				resetSampleRates[c] = sampleRate;
+			}
+			else {
+				resetChannel(c, sampleRate, antialiasingDesign);
+				resetSampleRates[c] = 0.f;
+			}
 		}
+		silentSamplesBeforeSleep = silenceTime * sampleRate;
+	}
+
+	// resets channel c's engines, from wherever they're processed
+	void resetChannel(int c, float sampleRate, const ripples::AAFilterCache::Entry* antialiasingDesign) {
+		engines[c].setSampleRate(sampleRate, antialiasingDesign);
+		antialiasingSwitches[c] = AntialiasingSwitch();
+		zdfEngines[c].setSampleRate(sampleRate);
+		linearEngines[c].setSampleRate(sampleRate);
+
+		FidelityState& state = fidelityStates[c];
+		state = FidelityState();
+		state.envelopeDecay = std::exp(-1.f / (envelopeReleaseTime * sampleRate));
+		state.linearMaxVOct = std::log2(linearMaxCutoff * sampleRate / ripples::kFilterMaxCutoff);
+		state.fullMinVOct = std::log2(fullMinCutoff * sampleRate / ripples::kFilterMaxCutoff);
+		state.linearHoldSamples = linearHoldTime * sampleRate;
+		state.fullWarmupSamples = fullWarmupTime * sampleRate;
+		state.crossfadeStep = 1.f / (crossfadeTime * sampleRate);
+	}
+
+	// called from the UI thread, as starting and stopping threads isn't real-time safe
+	void setWorkerThreads(bool enable) {
+		workerThreads = enable;
+		updateWorkerPool();
+	}
+
+	// Starts or stops the threads to match the option, called from the UI thread. Patches only
+	// store the option, so the threads start once the module is added to the engine (or, for a
+	// preset loaded onto it, by the widget), not while it's being loaded.
+	void updateWorkerPool() {
+		if (workerThreads && !workerPool.isRunning()) {
+			workerPool.start(numWorkers, [this](int worker) {
+				return processWorkerJobs(worker);
+			});
+		}
+		else if (!workerThreads && workerPool.isRunning()) {
+			// process() then processes any queued block itself, and takes the engines back on its next call
+			workerPool.stop();
+		}
+	}
+
+	// hands the workers their channels' engines, with silence to read back until the first results come in
+	void startWorkerJobs() {
+		for (int c = 0; c < NUM_CHANNELS; c++) {
+			readingBlocks[c] = ChannelBlock();
+			nextBlocks[c] = ChannelBlock();
+			nextBlockValid[c] = false;
+		}
+		firstWorkerBlock = blockSequence;
+		blockPosition = 0;
+		lateBlocks = 0;
+		workersActive = true;
+	}
+
+	// Takes the engines back once the threads have been joined. The blocks they left, and the part
+	// of a block that was being filled, are processed here, so that no reset is lost.
+	void stopWorkerJobs() {
+		for (int c = 0; c < NUM_CHANNELS; c++) {
+			if (c >= firstWorkerChannel) {
+				WorkerRings& rings = workerRings[c - firstWorkerChannel];
+				while (!rings.jobs.empty()) {
+					ChannelBlock block = rings.jobs.shift();
+					processBlock(c, block);
+				}
+				rings.results.clear();
+			}
+			for (int n = 0; n < blockPosition; n++) {
+				processChannel(c, fillingBlocks[c].jobs[n]);
+			}
+		}
+		workersActive = false;
+	}
+
+	void processBlock(int c, ChannelBlock& block) {
+		for (ChannelJob& job : block.jobs) {
+			processChannel(c, job);
+		}
+	}
+
+	// called once a block has been filled, hands it on and sets up the results to read next
+	void rotateBlocks() {
+		for (int c = 0; c < NUM_CHANNELS; c++) {
+			fillingBlocks[c].sequence = blockSequence;
+
+			if (c < firstWorkerChannel) {
+				// read next time, after the block that was processed last time
+				processBlock(c, fillingBlocks[c]);
+				std::swap(readingBlocks[c], nextBlocks[c]);
+				std::swap(nextBlocks[c], fillingBlocks[c]);
+				continue;
+			}
+
+			WorkerRings& rings = workerRings[c - firstWorkerChannel];
+			if (rings.jobs.full()) {
+				// the worker is far behind, drop the block
+				lateBlocks++;
+			}
+			else {
+				rings.jobs.push(fillingBlocks[c]);
+			}
+			readWorkerResults(c, blockSequence - 1);
+		}
+		blockSequence++;
+		blockPosition = 0;
+	}
+
+	// moves the worker's results for block due to be read next, or holds the channel's last output
+	void readWorkerResults(int c, uint32_t due) {
+		ChannelBlock& reading = readingBlocks[c];
+		// sequence numbers wrap around, so compare their differences
+		if ((int32_t)(due - firstWorkerBlock) < 0) {
+			return;
+		}
+
+		WorkerRings& rings = workerRings[c - firstWorkerChannel];
+		while (nextBlockValid[c] || !rings.results.empty()) {
+			if (!nextBlockValid[c]) {
+				nextBlocks[c] = rings.results.shift();
+				nextBlockValid[c] = true;
+			}
+			const int32_t age = due - nextBlocks[c].sequence;
+			if (age < 0) {
+				// the block that was due was dropped
+				break;
+			}
+			nextBlockValid[c] = false;
+			if (age == 0) {
+				std::swap(reading, nextBlocks[c]);
+				return;
+			}
+		}
+
+		for (ChannelJob& job : reading.jobs) {
+			job = reading.jobs[workerBlockSize - 1];
+		}
+		lateBlocks++;
+	}
+
+	// runs on the worker threads, each owns one channel's engines
+	bool processWorkerJobs(int worker) {
+		WorkerRings& rings = workerRings[worker];
+		if (rings.jobs.empty()) {
+			return false;
+		}
+		ChannelBlock block = rings.jobs.shift();
+		processBlock(firstWorkerChannel + worker, block);
+		// dropped if process() has stopped reading them
+		if (!rings.results.full()) {
+			rings.results.push(block);
+		}
+		return true;
+	}
+
+	// Runs channel c's engines on one frame, from process() or a worker thread
+	void processChannel(int c, ChannelJob& job) {
+		ripples::RipplesEngine::Frame& frame = job.frame;
+		if (job.resetSampleRate > 0.f) {
+			resetChannel(c, job.resetSampleRate, job.resetAntialiasingDesign);
+		}
+		if (job.resetEngines) {
+			antialiasingSwitches[c] = AntialiasingSwitch();
+			engines[c].reset();
+			zdfEngines[c].reset();
+			linearEngines[c].reset();
+		}
+
+		if (job.engineState != AWAKE) {
+			// nothing is lost by switching in a runtime anti-aliasing design now
+			updateAntialiasing(c);
+			frame.hp2 = frame.bp4 = frame.lp4 = 0.f;
+		}
+		else if (job.filterSimulationType == CIRCUIT_BASED) {
+			zdfEngines[c].process(frame);
+		}
+		else if (job.adaptiveFidelity || fidelityStates[c].fullWeight < 1.f) {
+			processAdaptive(c, frame, job.processEngine, job.adaptiveFidelity);
+		}
+		else {
+			processFull(c, frame, job.processEngine);
+		}
+	}
+
+	// Runs channel c's heuristic engine, fading in a runtime anti-aliasing design once it's ready
+	void processFull(int c, ripples::RipplesEngine::Frame& frame, ripples::RipplesEngine::ProcessFunction processEngine) {
+		AntialiasingSwitch& aaSwitch = antialiasingSwitches[c];
+		if (!aaSwitch.active && engines[c].isAntialiasingUpdateReady()) {
+			switchingEngines[c] = engines[c];
+			aaSwitch.active = switchingEngines[c].updateAntialiasing();
+			if (!aaSwitch.active) {
+				// the design isn't usable, drop it
+				engines[c].updateAntialiasing();
+			}
+			aaSwitch.warmupSamples = fidelityStates[c].fullWarmupSamples;
+			aaSwitch.weight = 0.f;
+		}
+
+		if (!aaSwitch.active) {
+			(engines[c].*processEngine)(frame);
+			return;
+		}
+
+		ripples::RipplesEngine::Frame switchingFrame = frame;
+		(engines[c].*processEngine)(frame);
+		(switchingEngines[c].*processEngine)(switchingFrame);
+
+		if (aaSwitch.warmupSamples > 0) {
+			aaSwitch.warmupSamples--;
+		}
+		else {
+			aaSwitch.weight = std::min(aaSwitch.weight + fidelityStates[c].crossfadeStep, 1.f);
+		}
+		frame.hp2 = crossfade(frame.hp2, switchingFrame.hp2, aaSwitch.weight);
+		frame.bp4 = crossfade(frame.bp4, switchingFrame.bp4, aaSwitch.weight);
+		frame.lp4 = crossfade(frame.lp4, switchingFrame.lp4, aaSwitch.weight);
+
+		if (aaSwitch.weight == 1.f) {
+			engines[c] = switchingEngines[c];
+			aaSwitch.active = false;
+		}
+	}
+
+	// Switches channel c's engine to a runtime anti-aliasing design directly, where it's silent
+	void updateAntialiasing(int c) {
+		antialiasingSwitches[c] = AntialiasingSwitch();
+		engines[c].updateAntialiasing();
+	}
+
+	// Runs the heuristic engine for channel c, or the linear model in its place when that is close enough
+	void processAdaptive(int c, ripples::RipplesEngine::Frame& frame, ripples::RipplesEngine::ProcessFunction processEngine,
+	                     bool adaptiveFidelity) {
+		FidelityState& state = fidelityStates[c];
+		state.envelope = std::max(std::abs(frame.input), state.envelope * state.envelopeDecay);
+
+		const float i_reso = ripples::VtoIConverter(ripples::kResAmpR, frame.res_cv, ripples::kResInputR,
+		                     frame.res_knob * ripples::kResKnobV, ripples::kResKnobR);
+		const float loopGain = ripples::ResonanceLoopGain(i_reso);
+
+		// as RipplesEngine computes it, the linear model would alias audio-rate FM
+		const float vOct = (frame.freq_knob - 1.f) * ripples::kFreqKnobVoltage + frame.freq_cv + frame.fm_cv * frame.fm_knob;
+		const float fmCurvature = std::abs(vOct - 2.f * state.vOctHistory[0] + state.vOctHistory[1]);
+		state.vOctHistory[1] = state.vOctHistory[0];
+		state.vOctHistory[0] = vOct;
+
+		if (state.envelope > fullMinEnvelope || loopGain > fullMinLoopGain || vOct > state.fullMinVOct
+		    || fmCurvature > linearMaxFmCurvature) {
+			state.linearSamples = 0;
+		}
+		else if (state.envelope < linearMaxEnvelope && loopGain < linearMaxLoopGain && vOct < state.linearMaxVOct) {
+			state.linearSamples = std::min(state.linearSamples + 1, state.linearHoldSamples);
+		}
+		// once the option is turned off, fade the full model back in before leaving it to process()
+		const bool useLinear = adaptiveFidelity && state.linearSamples >= state.linearHoldSamples;
+
+		// the linear model only runs while it may take over or is being faded out, starting from
+		// the full model's state and with linearHoldSamples to settle before it's heard
+		float_4 linearOutputs = 0.f;
+		const bool runLinear = state.linearSamples > 0 || state.fullWeight < 1.f;
+		if (runLinear) {
+			if (!state.linearActive) {
+				linearEngines[c].setCellVoltages(engines[c].getCellVoltages());
+			}
+			ripples::RipplesEngine::Frame linearFrame = frame;
+			linearEngines[c].process(linearFrame);
+			linearOutputs = delayLinearOutputs(state, float_4(linearFrame.hp2, linearFrame.bp4, linearFrame.lp4, 0.f),
+			                                   engines[c].getLatency());
+		}
+		state.linearActive = runLinear;
+
+		// the full model has been idle, start it from the linear model's state and let its
+		// anti-aliasing filters settle before fading it in
+		if (!useLinear && state.fullWeight == 0.f && state.warmupSamples == 0) {
+			updateAntialiasing(c);
+			engines[c].setCellVoltages(linearEngines[c].getCellVoltages());
+			state.warmupSamples = state.fullWarmupSamples;
+		}
+		// the warm-up counts down whichever model is wanted, so that if the linear one is wanted
+		// again meanwhile, the full one still stops once it's over, and starts afresh next time
+		if (state.warmupSamples > 0) {
+			state.warmupSamples--;
+		}
+
+		if (useLinear) {
+			state.fullWeight = std::max(state.fullWeight - state.crossfadeStep, 0.f);
+		}
+		else if (state.warmupSamples == 0) {
+			state.fullWeight = std::min(state.fullWeight + state.crossfadeStep, 1.f);
+		}
+
+		if (state.fullWeight > 0.f || state.warmupSamples > 0) {
+			processFull(c, frame, processEngine);
+			frame.hp2 = crossfade(linearOutputs[0], frame.hp2, state.fullWeight);
+			frame.bp4 = crossfade(linearOutputs[1], frame.bp4, state.fullWeight);
+			frame.lp4 = crossfade(linearOutputs[2], frame.lp4, state.fullWeight);
+		}
+		else {
+			frame.hp2 = linearOutputs[0];
+			frame.bp4 = linearOutputs[1];
+			frame.lp4 = linearOutputs[2];
+		}
+	}
+
+	// Delays the linear model's outputs by the full model's latency, interpolating linearly
+	float_4 delayLinearOutputs(FidelityState& state, float_4 outputs, float latency) {
+		state.linearOutputIndex = (state.linearOutputIndex + 1) % linearDelaySize;
+		state.linearOutputs[state.linearOutputIndex] = outputs;
+
+		latency = clamp(latency, 0.f, linearDelaySize - 2.f);
+		const int delay = latency;
+		const float fraction = latency - delay;
+		const int index = state.linearOutputIndex + linearDelaySize - delay;
+		const float_4 newer = state.linearOutputs[index % linearDelaySize];
+		const float_4 older = state.linearOutputs[(index - 1) % linearDelaySize];
+		return newer + (older - newer) * fraction;
+	}
+
+	// update silence tracking for channel c, returns true if the engine may sleep
+	bool isSilent(int c, const ripples::RipplesEngine::Frame& frame) {
+		bool quiet = std::abs(frame.input) < silenceThreshold && outputLevels[c] < silenceThreshold;
+		if (quiet) {
+			const float i_reso = ripples::VtoIConverter(ripples::kResAmpR, frame.res_cv, ripples::kResInputR,
+			                     frame.res_knob * ripples::kResKnobV, ripples::kResKnobR);
+			quiet = ripples::ResonanceLoopGain(i_reso) < maxSleepingLoopGain;
+		}
+
+		silentSamples[c] = quiet ? std::min(silentSamples[c] + 1, silentSamplesBeforeSleep) : 0;
+		return silentSamples[c] >= silentSamplesBeforeSleep;
 	}
 
 	void process(const ProcessArgs& args) override {
@@ -93,9 +586,31 @@ struct Atlas : Module {
 		ripples::RipplesEngine::Frame frame;
 		frame.fm_knob = 1.;
 		frame.addLowend = addLowend;
+		frame.gainCompensation = compensate;
 		frame.clipOutputs = clipOutput;
+		frame.antialiasClipping = antialiasClipping;
+		// the menu options are fixed for this call, so pick the matching engine core once
+		const ripples::RipplesEngine::ProcessFunction processEngine = engines[0].getProcessFunction(clipOutput, addLowend);
 
 		const bool updateLeds = lightDivider.process();
+		const bool scanConnected = outputs[SCAN_OUT_OUTPUT].isConnected();
+
+		const bool useWorkers = workerThreads && workerPool.isRunning();
+		if (useWorkers != workersActive) {
+			if (useWorkers) {
+				startWorkerJobs();
+			}
+			else {
+				stopWorkerJobs();
+			}
+		}
+
+		const FilterSimulationType filterSimulationType = this->filterSimulationType;
+		if (filterSimulationType != activeFilterSimulationType) {
+			reset(args.sampleRate);
+			activeFilterSimulationType = filterSimulationType;
+		}
+		const bool adaptiveFidelity = this->adaptiveFidelity;
 
 		const float_4 resonanceKnob = float_4(
 			params[RES1_PARAM + 0].getValue(),
@@ -127,7 +642,7 @@ struct Atlas : Module {
 		const float_4 frequenciesScaled = simd::rescale(frequencies, std::log2(ripples::kFreqKnobMin), std::log2(ripples::kFreqKnobMax), 0.f, 1.f);
 
 		float normalInput = 0.f, normalFreqInput = 0.f;
-		float_4 outputs_4;
+		float_4 outputs_4, responses, inputs_4;
 		for (int i = 0; i < NUM_CHANNELS; i++) {
 			const CVDest cvDest = static_cast<CVDest>(params[FM_RES_1_PARAM + i].getValue());
 			const FilterMode mode = static_cast<FilterMode>(params[MODE1_PARAM + i].getValue());
@@ -142,17 +657,73 @@ struct Atlas : Module {
 			frame.input = (inputs[IN1_INPUT + i].isConnected() ? inputs[IN1_INPUT + i].getVoltageSum() : normalInput);
 			normalInput = frame.input;
 
-			engines[i].process(frame);
+			EngineState engineState = AWAKE;
+			if (!outputs[OUT1_OUTPUT + i].isConnected() && !scanConnected) {
+				engineState = SLEEPING_UNPATCHED;
+			}
+			else if (isSilent(i, frame)) {
+				engineState = SLEEPING_SILENT;
+			}
+
+			ChannelJob job;
+			job.frame = frame;
+			job.processEngine = processEngine;
+			job.filterSimulationType = filterSimulationType;
+			job.adaptiveFidelity = adaptiveFidelity;
+			job.engineState = engineState;
+			// a silent engine resumes from its (near zero) state, but an unpatched one
+			// may hold a stale tail from before it was disconnected
+			job.resetEngines = engineState == AWAKE && engineStates[i] == SLEEPING_UNPATCHED;
+			engineStates[i] = engineState;
+			job.resetSampleRate = resetSampleRates[i];
+			job.resetAntialiasingDesign = antialiasingDesign;
+			resetSampleRates[i] = 0.f;
+
+			if (workersActive) {
+				// swap this frame's job for the result from two blocks ago
+				fillingBlocks[i].jobs[blockPosition] = job;
+				job = readingBlocks[i].jobs[blockPosition];
+			}
+			else {
+				processChannel(i, job);
+			}
 
-			// Atlas actually corrects for inverting effect
-			outputs_4[i] = -(mode == LP ? frame.lp4 : (mode == BP ? frame.bp4 : 0.5 * frame.hp2));
+			if (job.engineState == AWAKE) {
+				// Atlas actually corrects for inverting effect
+				responses = -float_4(job.frame.lp4, 0.5 * job.frame.hp2, job.frame.bp4, 0.f);
+				outputLevels[i] = std::max({std::abs(job.frame.lp4), std::abs(job.frame.bp4), std::abs(job.frame.hp2)});
+			}
+			else {
+				responses = 0.f;
+			}
+
+			// responses are ordered as FilterMode
+			outputs_4[i] = responses[mode];
+
+			if (polyOutputs) {
+				outputs[OUT1_OUTPUT + i].setChannels(3);
+				outputs[OUT1_OUTPUT + i].setVoltageSimd(responses, 0);
+			}
+			else {
+				outputs[OUT1_OUTPUT + i].setChannels(1);
+				outputs[OUT1_OUTPUT + i].setVoltage(outputs_4[i]);
+			}
+
+			inputs_4[i] = normalInput;
+		}
 
-			outputs[OUT1_OUTPUT + i].setVoltage(outputs_4[i]);
+		if (workersActive && ++blockPosition == workerBlockSize) {
+			rotateBlocks();
+		}
 
-			if (updateLeds) {
-				const float sampleTime = args.sampleTime * lightUpdateRate;
-				lights[NUM1_LIGHT + i].setBrightnessSmooth(std::abs(normalInput / 5.f), sampleTime, lambda);
+		inputLevels.process(inputs_4);
+		if (updateLeds) {
+			const float sampleTime = args.sampleTime * lightUpdateRate;
+			const float_4 inputPeaks = inputLevels.getPeak();
+			for (int i = 0; i < NUM_CHANNELS; i++) {
+				lights[NUM1_LIGHT + i].setBrightnessSmooth(inputPeaks[i] / 5.f, sampleTime, lambda);
 			}
+			inputLevels.reset();
 		}
 
 		// Scan output
@@ -168,7 +739,11 @@ struct Atlas : Module {
 		json_t* rootJ = json_object();
 		json_object_set_new(rootJ, "gainCompensation", json_boolean(compensate));
 		json_object_set_new(rootJ, "addLowend", json_boolean(addLowend));
-		json_object_set_new(rootJ, "filterSimulationType", json_integer(static_cast<int>(filterSimulationType)));
+		json_object_set_new(rootJ, "filterSimulationType", json_integer(static_cast<int>(filterSimulationType.load())));
+		json_object_set_new(rootJ, "polyOutputs", json_boolean(polyOutputs));
+		json_object_set_new(rootJ, "antialiasClipping", json_boolean(antialiasClipping));
+		json_object_set_new(rootJ, "adaptiveFidelity", json_boolean(adaptiveFidelity.load()));
+		json_object_set_new(rootJ, "workerThreads", json_boolean(workerThreads.load()));
 
 		return rootJ;
 	}
@@ -188,6 +763,27 @@ struct Atlas : Module {
 		if (jFilterSimulationType) {
 			filterSimulationType = static_cast<FilterSimulationType>(json_integer_value(jFilterSimulationType));
 		}
+
+		json_t* jPolyOutputs = json_object_get(rootJ, "polyOutputs");
+		if (jPolyOutputs) {
+			polyOutputs = json_boolean_value(jPolyOutputs);
+		}
+
+		json_t* jAntialiasClipping = json_object_get(rootJ, "antialiasClipping");
+		if (jAntialiasClipping) {
+			antialiasClipping = json_boolean_value(jAntialiasClipping);
+		}
+
+		json_t* jAdaptiveFidelity = json_object_get(rootJ, "adaptiveFidelity");
+		if (jAdaptiveFidelity) {
+			adaptiveFidelity = json_boolean_value(jAdaptiveFidelity);
+		}
+
+		json_t* jWorkerThreads = json_object_get(rootJ, "workerThreads");
+		if (jWorkerThreads) {
+			// the threads are started by onAdd() or the widget, see updateWorkerPool()
+			workerThreads = json_boolean_value(jWorkerThreads);
+		}
 	}
 };
 
@@ -228,6 +824,15 @@ struct AtlasWidget : ModuleWidget {
 		addChild(createLight<VostokOrangeNumberLed<4>>(mm2px(Vec(41.074, 89.511)), module, Atlas::NUM1_LIGHT + 3));
 	}
 
+	void step() override {
+		Atlas* atlas = dynamic_cast<Atlas*>(module);
+		if (atlas) {
+			atlas->updateWorkerPool();
+		}
+
+		ModuleWidget::step();
+	}
+
 
 	void appendContextMenu(Menu* menu) override {
 		Atlas* module = dynamic_cast<Atlas*>(this->module);
@@ -238,11 +843,37 @@ struct AtlasWidget : ModuleWidget {
 		[ = ](Menu * menu) {
 			menu->addChild(createBoolPtrMenuItem("Clip Output ±10V", "", &module->clipOutput));
 		}));
+		menu->addChild(createIndexSubmenuItem("Filter simulation type", {"Heuristic", "Circuit based"},
+		[ = ]() {
+			return module->filterSimulationType.load();
+		},
+		[ = ](int type) {
+			module->filterSimulationType = static_cast<Atlas::FilterSimulationType>(type);
+		}));
+		menu->addChild(createBoolPtrMenuItem("Anti-aliased clipping (circuit based)", "", &module->antialiasClipping));
+		menu->addChild(createBoolPtrMenuItem("Polyphonic outputs (LP, HP, BP)", "", &module->polyOutputs));
+		menu->addChild(createBoolMenuItem("Adaptive fidelity (heuristic model)", "",
+		[ = ]() {
+			return module->adaptiveFidelity.load();
+		},
+		[ = ](bool enable) {
+			module->adaptiveFidelity = enable;
+		}));
+		menu->addChild(createBoolMenuItem("Worker threads", string::f("%d samples latency", Atlas::workerLatency),
+		[ = ]() {
+			return module->workerThreads.load();
+		},
+		[ = ](bool enable) {
+			module->setWorkerThreads(enable);
+		}));
+		const int lateBlocks = module->lateBlocks;
+		if (module->workerThreads && lateBlocks > 0) {
+			menu->addChild(createMenuLabel(string::f("%d late blocks, held at their last output", lateBlocks)));
+		}
 
 		// debug options only, don't expose to users yet
 		// menu->addChild(createBoolPtrMenuItem("Gain compensation (LP/BP only)", "", &module->compensate));
 		// menu->addChild(createBoolPtrMenuItem("Add lowend to HP", "", &module->addLowend));
-		// menu->addChild(createIndexPtrSubmenuItem("Filter simulation type", {"Heuristic", "Circuit based"}, &module->filterSimulationType));
 	}
 };
 
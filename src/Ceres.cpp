@@ -25,7 +25,15 @@ struct Ceres : Module {
 	};
 
 	bool clipOutput = true;
+	// opt-in, as it costs half a sample of delay and some top end
+	bool antialiasClipping = false;
 	dsp::ClockDivider lightDivider;
+	// channels 1-4 and 5-6
+	PeakAccumulator outputLevels[2];
+	// patched outputs are not summed to the mix output, updated in onPortChange()
+	bool summed[NUM_CHANNELS];
+	// clipping of the mix output, per group of four voices
+	Clip4ADAA<float_4> mixClippers[4];
 
 	Ceres() {
 		config(PARAMS_LEN, INPUTS_LEN, OUTPUTS_LEN, LIGHTS_LEN);
@@ -41,42 +49,87 @@ struct Ceres : Module {
 		}
 
 		lightDivider.setDivision(lightUpdateRate);
+		updateSummedChannels();
+	}
+
+	void onPortChange(const PortChangeEvent& e) override {
+		if (e.type == Port::OUTPUT) {
+			updateSummedChannels();
+		}
+	}
+
+	void updateSummedChannels() {
+		for (int i = 0; i < NUM_CHANNELS; i++) {
+			summed[i] = !outputs[OUT1_OUTPUT + i].isConnected() || (i == NUM_CHANNELS - 1);
+		}
 	}
 
 	void process(const ProcessArgs& args) override {
 		
 		const bool updateLEDs = lightDivider.process();
 
-		float normalVoltage = 0.f;
-		float mix = 0.f;
+		// unpatched inputs are normalled to the previous channel, voice by voice
+		float_4 normalVoltages[4] = {0.f, 0.f, 0.f, 0.f};
+		int normalChannels = 1;
+		float_4 mix[4] = {0.f, 0.f, 0.f, 0.f};
+		int mixChannels = 1;
+		// highest voice of each channel, for the LEDs
+		float_4 outs[2] = {0.f, 0.f};
 		for (int i = 0; i < NUM_CHANNELS; i++) {
-			const float level = clamp(params[LEVEL1_PARAM + i].getValue() * inputs[CV1_INPUT + i].getNormalVoltage(5.f) / 5.f, 0.f, 1.f);
-			const float in = inputs[IN1_INPUT + i].getNormalVoltage(normalVoltage);
-			normalVoltage = in;
-			const float out = in * level;
-
-			// patched outputs are not summed to the mix output
-			bool isSummed = !outputs[OUT1_OUTPUT + i].isConnected() || (i == NUM_CHANNELS - 1);
-			mix += out * (isSummed ? 1.f : 0.f);
-
-			outputs[OUT1_OUTPUT + i].setVoltage(out);
-			if (updateLEDs) {
-				const float sampleTime = args.sampleTime * lightUpdateRate;
-				lights[NUM1_LIGHT + i].setBrightnessSmooth(out / 4.f, sampleTime, lambda);
+			Input& in = inputs[IN1_INPUT + i];
+			Input& cv = inputs[CV1_INPUT + i];
+			const int channels = in.isConnected() ? in.getChannels() : normalChannels;
+			const float levelParam = params[LEVEL1_PARAM + i].getValue();
+
+			float_4 maxOut = -INFINITY;
+			for (int c = 0; c < channels; c += 4) {
+				if (in.isConnected()) {
+					normalVoltages[c / 4] = getVoicesSimd(in, c);
+				}
+				const float_4 cvVoltage = cv.isConnected() ? cv.getPolyVoltageSimd<float_4>(c) : 5.f;
+				const float_4 level = simd::clamp(levelParam * cvVoltage / 5.f, 0.f, 1.f);
+				const float_4 out = normalVoltages[c / 4] * level;
+
+				if (summed[i]) {
+					mix[c / 4] += out;
+				}
+				outputs[OUT1_OUTPUT + i].setVoltageSimd(out, c);
+				maxOut = simd::fmax(maxOut, simd::ifelse(voiceMask(c, channels), out, -INFINITY));
 			}
+			outputs[OUT1_OUTPUT + i].setChannels(channels);
+
+			normalChannels = channels;
+			if (summed[i]) {
+				mixChannels = std::max(mixChannels, channels);
+			}
+			outs[i / 4][i % 4] = horizontalMax(maxOut);
 		}
 
-		if (clipOutput) {
-			mix = clip4(mix);
+		outputLevels[0].process(outs[0]);
+		outputLevels[1].process(outs[1]);
+		if (updateLEDs) {
+			const float sampleTime = args.sampleTime * lightUpdateRate;
+			for (int i = 0; i < NUM_CHANNELS; i++) {
+				lights[NUM1_LIGHT + i].setBrightnessSmooth(outputLevels[i / 4].max[i % 4] / 4.f, sampleTime, lambda);
+			}
+			outputLevels[0].reset();
+			outputLevels[1].reset();
 		}
 
 		// channel 6 is always the mix output
-		outputs[OUT1_OUTPUT + 5].setVoltage(mix);
+		for (int c = 0; c < mixChannels; c += 4) {
+			if (clipOutput) {
+				mix[c / 4] = antialiasClipping ? mixClippers[c / 4].process(mix[c / 4]) : mixClippers[c / 4].processNaive(mix[c / 4]);
+			}
+			outputs[OUT1_OUTPUT + 5].setVoltageSimd(mix[c / 4], c);
+		}
+		outputs[OUT1_OUTPUT + 5].setChannels(mixChannels);
 	}
 
 	json_t* dataToJson() override {
 		json_t* rootJ = json_object();
 		json_object_set_new(rootJ, "clipOutput", json_boolean(clipOutput));
+		json_object_set_new(rootJ, "antialiasClipping", json_boolean(antialiasClipping));
 		return rootJ;
 	}
 
@@ -85,6 +138,11 @@ struct Ceres : Module {
 		if (clipOutputJ) {
 			clipOutput = json_boolean_value(clipOutputJ);
 		}
+
+		json_t* antialiasClippingJ = json_object_get(rootJ, "antialiasClipping");
+		if (antialiasClippingJ) {
+			antialiasClipping = json_boolean_value(antialiasClippingJ);
+		}
 	}
 };
 
@@ -130,6 +188,7 @@ struct CeresWidget : ModuleWidget {
 		[ = ](Menu * menu) {
 			menu->addChild(createBoolPtrMenuItem("Clip Output ±10V", "", &ceres->clipOutput));
 		}));
+		menu->addChild(createBoolPtrMenuItem("Anti-aliased clipping", "", &ceres->antialiasClipping));
 	}
 };
 
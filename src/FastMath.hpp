@@ -0,0 +1,90 @@
+#pragma once
+#include <rack.hpp>
+#include <cstring>
+
+
+/** Fast approximations of the transcendental functions used in the modules' per-sample code.
+
+Each works on float and float_4, lane by lane. The error bounds quoted are checked by
+bench/FastMath.cpp. Rack's SDK has no wider vector type, but the templates only need the simd
+operators and a floatBits()/bitsFloat() pair, so adding one is a matter of two overloads.
+*/
+
+// the bits of a float (or of each lane) as an integer, and back
+inline int32_t floatBits(float x) {
+	int32_t bits;
+	std::memcpy(&bits, &x, sizeof(bits));
+	return bits;
+}
+
+inline rack::simd::int32_4 floatBits(rack::simd::float_4 x) {
+	return rack::simd::int32_4::cast(x);
+}
+
+inline float bitsFloat(int32_t bits) {
+	float x;
+	std::memcpy(&x, &bits, sizeof(x));
+	return x;
+}
+
+inline rack::simd::float_4 bitsFloat(rack::simd::int32_4 bits) {
+	return rack::simd::float_4::cast(bits);
+}
+
+// clamp(), but without the NaN handling of std::fmin() and std::fmax(), which are library calls
+inline float fastClamp(float x, float a, float b) {
+	return std::min(std::max(x, a), b);
+}
+
+inline rack::simd::float_4 fastClamp(rack::simd::float_4 x, rack::simd::float_4 a, rack::simd::float_4 b) {
+	return rack::simd::clamp(x, a, b);
+}
+
+// 2^x, to within 2e-7 (relative) for |x| < 126, clamped outside that
+template <typename T>
+T fastExp2(T x) {
+	using Int = decltype(floatBits(x));
+
+	x = fastClamp(x, -126.f, 126.f);
+	const T whole = rack::simd::floor(x);
+	const T f = x - whole;
+	// minimax polynomial for 2^f on [0, 1)
+	const T fraction = 1.f + f * (0.693151312f + f * (0.240164454f + f * (0.0557998982f + f * (0.00901705182f + f * 0.00186711972f))));
+	// 2^whole, straight into the exponent bits
+	return fraction * bitsFloat((Int(whole) + Int(127)) << 23);
+}
+
+// log2(x) for normal x > 0, to within 5e-7 (relative where |log2(x)| > 1)
+template <typename T>
+T fastLog2(T x) {
+	using Int = decltype(floatBits(x));
+
+	// x = m * 2^e, with m in [1, 2)
+	const Int bits = floatBits(x);
+	const T e = T((bits >> 23) - Int(127));
+	const T t = bitsFloat((bits & Int(0x007fffff)) | Int(0x3f800000)) - 1.f;
+	// minimax polynomial for log2(1 + t) on [0, 1)
+	return e + t * (1.44266783f + t * (-0.720585467f + t * (0.473553413f + t * (-0.32590201f + t * (0.19429442f + t * (-0.0795578326f + t * 0.0155299546f))))));
+}
+
+// Pade approximant of tanh(x), clamped where its slope reaches zero. To within 1.1e-2, and
+// monotonic, so suited to saturators more than to exact work.
+template <typename T>
+T fastTanh(T x) {
+	// 2 sqrt(3)
+	const float limit = 3.46410162f;
+	x = fastClamp(x, -limit, limit);
+	const T x2 = x * x;
+	const T q = 12.f + x2;
+	return 12.f * x * q / (36.f * x2 + q * q);
+}
+
+// sqrt(x), exact. The hardware square root measures no slower than a reciprocal square root
+// estimate with the Newton-Raphson step needed to match it, so there is nothing to gain there.
+inline float fastSqrt(float x) {
+	return std::sqrt(x);
+}
+
+inline rack::simd::float_4 fastSqrt(rack::simd::float_4 x) {
+	return rack::simd::sqrt(x);
+}
@@ -1,4 +1,5 @@
 #include "plugin.hpp"
+#include "FastMath.hpp"
 
 
 struct Fuji : Module {
@@ -54,105 +55,166 @@ struct Fuji : Module {
 			configOutput(OUT1_OUTPUT + i, string::f("Ch. %d", i + 1));
 		}
 
+		for (int i = 0; i < NUM_CHANNELS; i++) {
+			logTimes[i] = float_4(midValue, midValue, 0.f, 0.f);
+		}
+
 		lightDivider.setDivision(lightUpdateRate);
 		// Start at the end of the cycle to ensure firing on the first process call
 		lightDivider.clock = lightDivider.division - 1;
 	}
 
-	dsp::ExponentialSlewLimiter attackSlew[NUM_CHANNELS];
-	dsp::ExponentialSlewLimiter decaySlew[NUM_CHANNELS];
-	dsp::SchmittTrigger gateTrigger[NUM_CHANNELS];
-	dsp::SchmittTrigger loopTrigger[NUM_CHANNELS];
-	dsp::PulseGenerator pulseGen[NUM_CHANNELS];
+	// per channel, in groups of four voices
+	dsp::TSchmittTrigger<float_4> gateTrigger[NUM_CHANNELS][4];
+	float_4 lastGates[NUM_CHANNELS][4] = {};
+	float_4 envelopes[NUM_CHANNELS][4] = {};
+	// the previous envelopes, with their polyBLAMP corrections, output by audio-rate loops
+	float_4 delayedEnvelopes[NUM_CHANNELS][4] = {};
+	// lane mask, the envelope is rising
+	float_4 rising[NUM_CHANNELS][4] = {};
+	bool looping[NUM_CHANNELS] = {};
+	// log10 of the attack (lane 0) and decay (lane 1) times, ramped towards the knobs between light updates
+	float_4 logTimes[NUM_CHANNELS];
+	float_4 logTimeSteps[NUM_CHANNELS] = {};
 	dsp::ClockDivider lightDivider;
 	const float lambdaFuji = 10.f;
-	bool rising[NUM_CHANNELS] = { false, false, false, false, false, false };
-	bool triggerChannels[NUM_CHANNELS] = { true, true, true, true, true, true };
+	// loops faster than this are band-limited
+	const float minAntialiasFrequency = 20.f;
+
+	// 1 - exp(-x), to within 1e-6 (relative) for x < 0.2, i.e. any time constant at 44.1 kHz
+	static float_4 slewCoefficient(float_4 x) {
+		return x * (1.f - x * (1.f / 2 - x * (1.f / 6 - x * (1.f / 24 - x * (1.f / 120)))));
+	}
+
+	// Advances the envelopes of group g of channel i by `time` (per lane, at most one sample), where
+	// riseX and fallX are the attack and decay rates times the sample time. Envelopes turn around
+	// at the point within the step where they reach +/-0.8, rather than on the next sample.
+	// If corrections is given, the polyBLAMP corrections of the previous and current sample for
+	// those corners are added to it, and timeAfter is the time from the end of the step to the sample.
+	void advanceEnvelopes(int i, int g, float_4 time, float riseX, float fallX, float_4 loop, float_4 sustain,
+	                      float_4 timeAfter = 0.f, float_4* corrections = nullptr) {
+		float_4& envelope = envelopes[i][g];
+		// loop mode slews between -1 and 1
+		float_4 target = simd::ifelse(rising[i][g], 1.f, simd::ifelse(loop, -1.f, 0.f));
+		const float_4 x = simd::ifelse(target > envelope, riseX, fallX);
+		float_4 next = envelope + (target - envelope) * slewCoefficient(x * time);
+
+		// the attack ends at the top (unless held), and a loop cycle at the bottom
+		const float_4 top = rising[i][g] & ~sustain & (next > 0.8f);
+		const float_4 bottom = loop & ~rising[i][g] & (next < -0.8f);
+		const float_4 corner = top | bottom;
+		if (simd::movemask(corner)) {
+			const float_4 level = simd::ifelse(top, 0.8f, -0.8f);
+			// the time left after the corner, interpolating linearly
+			const float_4 remaining = time * (next - level) / (next - envelope);
+			rising[i][g] = simd::ifelse(top, 0.f, simd::ifelse(bottom, float_4::mask(), rising[i][g]));
+			const float_4 slopeBefore = x * (target - level);
+			target = simd::ifelse(rising[i][g], 1.f, simd::ifelse(loop, -1.f, 0.f));
+			const float_4 turnedX = simd::ifelse(target > level, riseX, fallX);
+			const float_4 turned = level + (target - level) * slewCoefficient(turnedX * remaining);
+			next = simd::ifelse(corner, turned, next);
+
+			if (corrections) {
+				// 2-point polyBLAMP, the residual of a unit slope change is (1 - |t|)^3 / 6 at t samples from it
+				const float_4 slopeChange = simd::ifelse(corner, turnedX * (target - level) - slopeBefore, 0.f);
+				const float_4 delay = remaining + timeAfter;
+				corrections[0] += slopeChange * delay * delay * delay / 6.f;
+				corrections[1] += slopeChange * (1.f - delay) * (1.f - delay) * (1.f - delay) / 6.f;
+			}
+		}
+		envelope = simd::clamp(next, -0.8f, 0.8f);
+	}
 
 	void process(const ProcessArgs& args) override {
 		const bool doUpdate = lightDivider.process();
 
-		float gateNormalVoltage = 0.f;
+		// unpatched gates are normalled to the previous channel, voice by voice
+		float_4 gateNormalVoltages[4] = {0.f, 0.f, 0.f, 0.f};
+		int normalChannels = 1;
 		for (int i = 0; i < NUM_CHANNELS; i++) {
+			Input& gateInput = inputs[GATE1_INPUT + i];
+			const int channels = gateInput.isConnected() ? gateInput.getChannels() : normalChannels;
 
-			const GateMode gateMode = static_cast<GateMode>(params[MODE1_PARAM + i].getValue());
-			const LoopMode loopMode = static_cast<LoopMode>(params[LOOP1_PARAM + i].getValue());
+			// the modes apply to every voice of the channel, as lane masks
+			const bool loopMode = params[LOOP1_PARAM + i].getValue() == LOOP;
+			const float_4 hold = params[MODE1_PARAM + i].getValue() == HOLD ? float_4::mask() : 0.f;
+			const float_4 loop = loopMode ? float_4::mask() : 0.f;
+			// loop mode starts a cycle straight away
+			const float_4 loopStarted = (loopMode && !looping[i]) ? float_4::mask() : 0.f;
+			looping[i] = loopMode;
 
 			if (doUpdate) {
-				// attack/decay times are only characteristic - here we scale based on empirical values
-				// to make the times close to desired times.
-				const float scaleFactor = 0.5f;
-				const float attackTime = scaleFactor * std::pow(10, params[ATTACK1_PARAM + i].getValue()); 	// range 1.5ms to 1.5s
-				const float decayTime = scaleFactor * std::pow(10, params[DECAY1_PARAM + i].getValue()); 	// range 1.5ms to 1.5s
-				attackSlew[i].setRiseFallTau(attackTime, decayTime);
+				// ramp to the knobs over the next lightUpdateRate samples
+				const float_4 targetLogTimes = float_4(params[ATTACK1_PARAM + i].getValue(), params[DECAY1_PARAM + i].getValue(), 0.f, 0.f);
+				logTimeSteps[i] = (targetLogTimes - logTimes[i]) / lightUpdateRate;
 			}
-
-			const float gateInput = inputs[GATE1_INPUT + i].getNormalVoltage(gateNormalVoltage);
-			const bool gateTriggered = gateTrigger[i].process(gateInput);
-			gateNormalVoltage = gateInput;
-
-			// if we're not in loop mode
-			if (loopMode == ONE_SHOT) {
-				// rising edge to gate input can trigger attack phase
-				if (gateTriggered) {
-					rising[i] = true;
+			logTimes[i] += logTimeSteps[i];
+
+			// attack/decay times are only characteristic - here we scale based on empirical values
+			// to make the times close to desired times, i.e. the time constants are 0.5 * 10^knob.
+			const float_4 rateTimesDelta = 2.f * args.sampleTime * fastExp2(-std::log2(10.f) * logTimes[i]);
+			const float riseX = rateTimesDelta[0];
+			const float fallX = rateTimesDelta[1];
+
+			// a loop cycle takes about ln(9) times the sum of the time constants
+			const float loopPeriod = std::log(9.f) * (1.f / riseX + 1.f / fallX) * args.sampleTime;
+			const bool audioRateLoop = loopMode && loopPeriod * minAntialiasFrequency < 1.f;
+
+			float maxEnvelope = -INFINITY;
+			for (int c = 0; c < channels; c += 4) {
+				const int g = c / 4;
+				if (gateInput.isConnected()) {
+					gateNormalVoltages[g] = getVoicesSimd(gateInput, c);
 				}
-				// or suppress the disabling of the rising edge by later code if in hold mode
-				if (gateMode == HOLD && gateTrigger[i].isHigh()) {
-					rising[i] = true; // Continue rising edge if gate is held
+				const float_4 gate = gateNormalVoltages[g];
+				const float_4 gateTriggered = gateTrigger[i][g].process(gate);
+				// one shot hold mode keeps rising while the gate is high
+				const float_4 sustain = hold & ~loop & gateTrigger[i][g].isHigh();
+
+				// only audio-rate loops pay for the polyBLAMP corrections
+				float_4 corrections[2] = {0.f, 0.f};
+				float_4* const blamp = audioRateLoop ? corrections : nullptr;
+
+				rising[i][g] = rising[i][g] | (sustain & ~gateTriggered) | loopStarted;
+				if (simd::movemask(gateTriggered)) {
+					// a rising edge (re)starts the attack from where the gate crossed the threshold
+					const float_4 beforeEdge = simd::ifelse(gateTriggered, simd::clamp((1.f - lastGates[i][g]) / (gate - lastGates[i][g]), 0.f, 1.f), 1.f);
+					advanceEnvelopes(i, g, beforeEdge, riseX, fallX, loop, sustain, 1.f - beforeEdge, blamp);
+					rising[i][g] = rising[i][g] | gateTriggered;
+					advanceEnvelopes(i, g, 1.f - beforeEdge, riseX, fallX, loop, sustain, 0.f, blamp);
 				}
-			}
-			else if (loopMode == LOOP) {
-				// loop mode ignores the gate input but resets in AD mode
-				if (triggerChannels[i] || gateTriggered) {
-					rising[i] = true; // Start rising edge
-					triggerChannels[i] = false; // Reset trigger state for this channel
+				else {
+					advanceEnvelopes(i, g, 1.f, riseX, fallX, loop, sustain, 0.f, blamp);
 				}
-			}
-
-			// Gate is high, start attack phase
-
-			float slewSignal = rising[i];
-			if (gateMode == HOLD && loopMode == ONE_SHOT) {
-				slewSignal = std::max(slewSignal, gateTrigger[i].isHigh() ? 1.f : 0.f);
-			}
-			if (loopMode == LOOP) {
-				slewSignal = 2.f * slewSignal - 1.f; // Convert to bipolar signal for loop mode
-			}
-
-			attackSlew[i].process(args.sampleTime, slewSignal);
-			attackSlew[i].out = clamp(attackSlew[i].out, -0.8f, 0.8f);
-			float envelope = attackSlew[i].out;
+				lastGates[i][g] = gate;
 
-			float out = 0.f;
-			if (loopMode == LOOP) {
-				if (envelope < -0.799f) {
-					triggerChannels[i] = true; // Set trigger state for this channel
+				const float_4 envelope = envelopes[i][g];
+				float_4 out;
+				if (audioRateLoop) {
+					// one sample late, so that the corrections for a corner can reach the sample before it
+					out = 10.f * (delayedEnvelopes[i][g] + corrections[0]);
 				}
-				else if (envelope > 0.799) {
-					rising[i] = false; // End rising edge
+				else {
+					// envelope is in the range [-0.8, 0.8], so scale to [-8, 8], and one shot to [0, 8]
+					out = simd::ifelse(loop, 10.f * envelope, simd::clamp(10.f * envelope, 0.f, 8.f));
 				}
+				delayedEnvelopes[i][g] = envelope + corrections[1];
+				outputs[OUT1_OUTPUT + i].setVoltageSimd(out, c);
 
-				// envelope is in the range [-0.8, 0.8], so scale to [-8, 8]
-				out = 10.f * envelope;
-			}
-			else {
-				if (envelope > 0.799) {
-					rising[i] = false; // End rising edge
+				if (doUpdate) {
+					maxEnvelope = std::max(maxEnvelope, horizontalMax(simd::ifelse(voiceMask(c, channels), envelope, -INFINITY)));
 				}
-				out = clamp(10.f * envelope, 0.f, 8.f);
 			}
-
-			outputs[OUT1_OUTPUT + i].setVoltage(out);
+			outputs[OUT1_OUTPUT + i].setChannels(channels);
+			normalChannels = channels;
 
 			if (doUpdate) {
 				const float sampleTime = args.sampleTime * lightUpdateRate;
 				// we don't want flickering at audio rates, but we also don't want LED light on negative bit of the cycle
 				// so can't do abs(envelope) here - use a smoother than usual setting
-				lights[NUM1_LIGHT + i].setBrightnessSmooth(envelope, sampleTime, lambdaFuji);
+				lights[NUM1_LIGHT + i].setBrightnessSmooth(maxEnvelope, sampleTime, lambdaFuji);
 			}
 		}
-
 	}
 };
 
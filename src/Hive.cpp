@@ -1,5 +1,9 @@
 #include "plugin.hpp"
 #include "ChowDSP.hpp"
+#include "FastMath.hpp"
+#include "kernels/Kernels.hpp"
+#include "WavRecorder.hpp"
+#include <osdialog.h>
 
 using simd::float_4;
 using simd::Vector;
@@ -38,19 +42,40 @@ struct Hive : Module {
 		NUM_SIDES = 2
 	};
 
-	struct ExpanderMessage {
-		float leftSum = 0.f;
-		float rightSum = 0.f;
-		bool chainActive = false;
+	// Hives chained on the left that the end of a chain mixes in, any further left are left out
+	static const int MAX_CHAINED = 16;
+
+	// A Hive whose outputs are unpatched, with a Hive on its right, is chained: it's a passive set of
+	// channel strips, and the Hive at the end of the chain reads its inputs and params in its own
+	// process(), within the same sample. Only reading other Hives keeps this race-free on Rack's
+	// worker threads, so the end Hive keeps the filter and clipper state of each chained Hive here.
+	struct ChainedHive {
+		Hive* hive = nullptr;
+		chowdsp::TBiquadFilter<float_4> dcBlockFilter[NUM_SIDES];
+		Clip4ADAA<float_4> sumClipper;
 	};
-	ExpanderMessage expanderMessage[2];
+	ChainedHive chainedHives[MAX_CHAINED];
 
 	chowdsp::TBiquadFilter<float_4> dcBlockFilter[NUM_SIDES];
+	// normalised to the sample rate, for these filters and the chained Hives'
+	float dcBlockCutoff = 30.f / 44100.f;
 	bool clipOutput = true;
+	// opt-in, as it costs half a sample of delay and some top end
+	bool antialiasClipping = false;
 	bool acCoupling = true;
 	dsp::ClockDivider lightDivider;
 	bool expanderActive = false;
-	dsp::VuMeter2 leftMeter, rightMeter;
+	// levels between light updates, of the left and right channel strips and (in lanes 0 and 1) the sums
+	PeakAccumulator leftStripLevels, rightStripLevels, sumLevels;
+	// the sum levels go to the widget, which runs the output meter
+	TelemetryRing<LevelFrame> sumTelemetry;
+	// optional recording of the output, see HiveWidget
+	WavRecorder recorder;
+
+	// channel strips after gain, pan and DC blocking
+	float_4 leftStrips = 0.f, rightStrips = 0.f;
+	// clipping of the sums, in lanes 0 and 1
+	Clip4ADAA<float_4> sumClipper;
 
 	Hive() {
 		config(PARAMS_LEN, INPUTS_LEN, OUTPUTS_LEN, LIGHTS_LEN);
@@ -69,129 +94,165 @@ struct Hive : Module {
 		configOutput(LEFT_OUTPUT, "Left");
 		configOutput(RIGHT_OUTPUT, "Right");
 
-		getLeftExpander().producerMessage = &expanderMessage[0];
-		getLeftExpander().consumerMessage = &expanderMessage[1];
-
 		lightDivider.setDivision(lightUpdateRate);
 	}
 
-	void onSampleRateChange() override {
-		float sampleRate = APP->engine->getSampleRate();
+	void onSampleRateChange(const SampleRateChangeEvent& e) override {
+		const float sampleRate = e.sampleRate;
 
 		// this doesn't work with floats below ~0.0004
-		const float fc = std::max(0.0004, (30. / sampleRate));
-		dcBlockFilter[0].setParameters(chowdsp::TBiquadFilter<float_4>::HIGHPASS, fc, 0.707, 1.0f);
-		dcBlockFilter[1].setParameters(chowdsp::TBiquadFilter<float_4>::HIGHPASS, fc, 0.707, 1.0f);
+		dcBlockCutoff = std::max(0.0004, (30. / sampleRate));
+		resetDcBlockFilters(dcBlockFilter);
+		for (ChainedHive& chained : chainedHives) {
+			resetDcBlockFilters(chained.dcBlockFilter);
+		}
 
-		dcBlockFilter[0].reset();
-		dcBlockFilter[1].reset();
+		// the file is labelled with the rate it started at, so frames at another rate don't belong in it
+		if (recorder.isRecording() && e.sampleRate != recorder.getSampleRate()) {
+			recorder.end(WavRecorder::SAMPLE_RATE_CHANGED);
+		}
 	}
 
-	void process(const ProcessArgs& args) override {
-
-		// Get input from left expander if present
-		float expanderLeftSum = 0.f;
-		float expanderRightSum = 0.f;
+	void resetDcBlockFilters(chowdsp::TBiquadFilter<float_4> filters[NUM_SIDES]) {
+		for (int side = 0; side < NUM_SIDES; ++side) {
+			filters[side].setParameters(chowdsp::TBiquadFilter<float_4>::HIGHPASS, dcBlockCutoff, 0.707, 1.0f);
+			filters[side].reset();
+		}
+	}
 
-		const ExpanderMessage* leftExpanderData = (ExpanderMessage*) getLeftExpander().consumerMessage;
-		Module* leftModule = getLeftExpander().module;
-		if (leftModule && leftModule->getModel() == modelHive && leftExpanderData) {
-			expanderLeftSum = leftExpanderData->leftSum;
-			expanderRightSum = leftExpanderData->rightSum;
-			expanderActive = leftExpanderData->chainActive;
+	// Each strip takes polyphonic inputs: the voices are panned (with per-voice pan CV) and
+	// summed, by the widest panStrips() kernel the CPU supports. AC coupling is linear so it runs
+	// once on the strip sums, which blocks DC in every voice. Only reads the Hive, so the end of a
+	// chain can run it on the Hives chained to it, with their filters.
+	static void processStrips(Hive* hive, chowdsp::TBiquadFilter<float_4> filters[NUM_SIDES], float_4& leftIns, float_4& rightIns) {
+		StripVoices strips[NUM_CHANNELS];
+		for (int i = 0; i < NUM_CHANNELS; ++i) {
+			Input& leftInput = hive->inputs[LEFT_INPUT + i];
+			Input& rightInput = hive->inputs[RIGHT_INPUT + i];
+			Input& panInput = hive->inputs[PAN_INPUT + i];
+			// an unpatched right input takes the left
+			Input& rightSource = rightInput.isConnected() ? rightInput : leftInput;
+
+			strips[i].left = leftInput.getVoltages();
+			strips[i].right = rightSource.getVoltages();
+			strips[i].panCv = panInput.getVoltages();
+			strips[i].leftChannels = leftInput.getChannels();
+			strips[i].rightChannels = rightSource.getChannels();
+			strips[i].panCvMonophonic = panInput.isMonophonic();
+			strips[i].pan = hive->params[PAN_PARAM + i].getValue();
+			strips[i].gain = hive->params[GAIN_PARAM + i].getValue();
 		}
-		else {
-			expanderActive = false;
+
+		kernels->panStrips(strips, &leftIns[0], &rightIns[0]);
+
+		// mixer is AC coupled (by default)
+		if (hive->acCoupling) {
+			leftIns = filters[LEFT].process(leftIns);
+			rightIns = filters[RIGHT].process(rightIns);
 		}
+	}
 
-		float_4 leftIns = float_4(
-		                    inputs[LEFT_INPUT + 0].getVoltage(),
-		                    inputs[LEFT_INPUT + 1].getVoltage(),
-		                    inputs[LEFT_INPUT + 2].getVoltage(),
-		                    inputs[LEFT_INPUT + 3].getVoltage());
-
-		float_4 rightIns = float_4(
-		                     inputs[RIGHT_INPUT + 0].getNormalVoltage(inputs[LEFT_INPUT + 0].getVoltage()),
-		                     inputs[RIGHT_INPUT + 1].getNormalVoltage(inputs[LEFT_INPUT + 1].getVoltage()),
-		                     inputs[RIGHT_INPUT + 2].getNormalVoltage(inputs[LEFT_INPUT + 2].getVoltage()),
-		                     inputs[RIGHT_INPUT + 3].getNormalVoltage(inputs[LEFT_INPUT + 3].getVoltage()));
-
-		float_4 panCvIns = float_4(
-		                     inputs[PAN_INPUT + 0].getVoltage(),
-		                     inputs[PAN_INPUT + 1].getVoltage(),
-		                     inputs[PAN_INPUT + 2].getVoltage(),
-		                     inputs[PAN_INPUT + 3].getVoltage());
-		float_4 panParams = float_4(
-		                      params[PAN_PARAM + 0].getValue(),
-		                      params[PAN_PARAM + 1].getValue(),
-		                      params[PAN_PARAM + 2].getValue(),
-		                      params[PAN_PARAM + 3].getValue());
-		float_4 pan = simd::clamp(panParams + panCvIns / 2.5f, -1.f, 1.f);
-
-		float_4 gains = float_4(
-		                  params[GAIN_PARAM + 0].getValue(),
-		                  params[GAIN_PARAM + 1].getValue(),
-		                  params[GAIN_PARAM + 2].getValue(),
-		                  params[GAIN_PARAM + 3].getValue());
+	// adds a Hive's strips to the sum of the Hives on its left, then applies its master gain and clipping
+	static void mixStrips(Hive* hive, float_4 leftIns, float_4 rightIns, Clip4ADAA<float_4>& clipper, float& leftSum, float& rightSum) {
+		const float masterParam = hive->params[MASTER_PARAM].getValue();
+		const float masterGain = masterParam * masterParam;
+		leftSum = masterGain * (leftIns[0] + leftIns[1] + leftIns[2] + leftIns[3] + leftSum);
+		rightSum = masterGain * (rightIns[0] + rightIns[1] + rightIns[2] + rightIns[3] + rightSum);
+
+		if (hive->clipOutput) {
+			const float_4 sums = float_4(leftSum, rightSum, 0.f, 0.f);
+			const float_4 clipped = hive->antialiasClipping ? clipper.process(sums) : clipper.processNaive(sums);
+			leftSum = clipped[0];
+			rightSum = clipped[1];
+		}
+	}
 
+	// whether the sum goes to the Hive on the right rather than to the outputs
+	bool isChained() {
+		Module* rightModule = getRightExpander().module;
+		return rightModule && rightModule->getModel() == modelHive
+		       && !outputs[LEFT_OUTPUT].isConnected() && !outputs[RIGHT_OUTPUT].isConnected();
+	}
 
-		// mixer is AC coupled (by default)
-		if (acCoupling) {
-			leftIns = dcBlockFilter[LEFT].process(leftIns);
-			rightIns = dcBlockFilter[RIGHT].process(rightIns);
+	// Sums the Hives chained on the left, farthest first, then this Hive. A bypassed Hive passes the
+	// sum from its left on unchanged.
+	void mixChain(float& leftSum, float& rightSum) {
+		Hive* chain[MAX_CHAINED];
+		int chainLength = 0;
+		Module* leftModule = getLeftExpander().module;
+		while (chainLength < MAX_CHAINED && leftModule && leftModule->getModel() == modelHive) {
+			Hive* leftHive = static_cast<Hive*>(leftModule);
+			if (!leftHive->isChained()) {
+				break;
+			}
+			chain[chainLength++] = leftHive;
+			leftModule = leftHive->getLeftExpander().module;
 		}
 
-		const float_4 panLeft = simd::clamp(1 - pan, 0.f, 1.f);
-		const float_4 panRight = simd::clamp(1 + pan, 0.f, 1.f);
+		leftSum = 0.f;
+		rightSum = 0.f;
+		for (int k = chainLength - 1; k >= 0; --k) {
+			ChainedHive& chained = chainedHives[k];
+			// a different Hive in this place starts from silence
+			if (chained.hive != chain[k]) {
+				chained.hive = chain[k];
+				resetDcBlockFilters(chained.dcBlockFilter);
+				chained.sumClipper.reset();
+			}
+			if (chain[k]->isBypassed()) {
+				continue;
+			}
+
+			float_4 leftIns, rightIns;
+			processStrips(chain[k], chained.dcBlockFilter, leftIns, rightIns);
+			mixStrips(chain[k], leftIns, rightIns, chained.sumClipper, leftSum, rightSum);
+		}
+		mixStrips(this, leftStrips, rightStrips, sumClipper, leftSum, rightSum);
+	}
 
-		// custom pan law, with  -1.5dB of center attenuation
-		leftIns *= gains * simd::sqrt(panLeft) * panLeft;
-		rightIns *= gains * simd::sqrt(panRight) * panRight;
+	// a bypassed Hive's outputs are silent, so the recording carries on with silence and stays in time
+	void processBypass(const ProcessArgs& args) override {
+		recorder.push(0.f, 0.f);
+		Module::processBypass(args);
+	}
 
-		// outputs
-		float masterGain = std::pow(params[MASTER_PARAM].getValue(), 2);
-		float leftSum = masterGain * (leftIns[0] + leftIns[1] + leftIns[2] + leftIns[3] + expanderLeftSum);
-		float rightSum = masterGain * (rightIns[0] + rightIns[1] + rightIns[2] + rightIns[3] + expanderRightSum);
+	void process(const ProcessArgs& args) override {
+		processStrips(this, dcBlockFilter, leftStrips, rightStrips);
 
-		if (clipOutput) {
-			leftSum = clip4(leftSum);
-			rightSum = clip4(rightSum);
+		// a chained Hive only shows its strips, its sum is mixed by the end of the chain (unless it's
+		// being recorded)
+		float leftSum = 0.f;
+		float rightSum = 0.f;
+		if (!isChained() || recorder.isRecording()) {
+			mixChain(leftSum, rightSum);
 		}
 
+		Module* leftModule = getLeftExpander().module;
+		expanderActive = leftModule && leftModule->getModel() == modelHive && static_cast<Hive*>(leftModule)->isChained();
+
 		outputs[LEFT_OUTPUT].setVoltage(leftSum);
 		outputs[RIGHT_OUTPUT].setVoltage(rightSum);
+		recorder.push(leftSum, rightSum);
 
-		leftMeter.process(args.sampleTime, std::abs(leftSum / 8.f));
-		rightMeter.process(args.sampleTime, std::abs(rightSum / 8.f));
-
-		float_4 leftsForLights = simd::abs(leftIns / 12.f);
-		float_4 rightsForLights = simd::abs(rightIns / 12.f);
-		for (int i = 0; i < NUM_CHANNELS; ++i) {
-			lights[NUM_LIGHT + i * 2].setBrightnessSmooth(leftsForLights[i], args.sampleTime);
-			lights[NUM_LIGHT + i * 2 + 1].setBrightnessSmooth(rightsForLights[i], args.sampleTime);
-		}
+		leftStripLevels.process(leftStrips);
+		rightStripLevels.process(rightStrips);
+		sumLevels.process(float_4(leftSum, rightSum, 0.f, 0.f));
 
 		if (lightDivider.process()) {
 			const float sampleTime = args.sampleTime * lightUpdateRate;
-			lights[LEFT_LIGHT].setBrightnessSmooth(leftMeter.getBrightness(-3.0f, 0.f), sampleTime);
-			lights[RIGHT_LIGHT].setBrightnessSmooth(rightMeter.getBrightness(-3.0f, 0.f), sampleTime);
-		}
-
-		// Send output to right expander
-		Module* rightModule = getRightExpander().module;
-		if (rightModule && rightModule->getModel() == modelHive) {
-			ExpanderMessage* expanderMessage = (ExpanderMessage*) rightModule->getLeftExpander().producerMessage;
 
-			const bool chainActive = !outputs[LEFT_OUTPUT].isConnected() && !outputs[RIGHT_OUTPUT].isConnected();
-			// it has to be already active, and not patched out
-			expanderActive = expanderActive && chainActive;
+			const float_4 leftsForLights = leftStripLevels.getPeak() / 12.f;
+			const float_4 rightsForLights = rightStripLevels.getPeak() / 12.f;
+			for (int i = 0; i < NUM_CHANNELS; ++i) {
+				lights[NUM_LIGHT + i * 2].setBrightnessSmooth(leftsForLights[i], sampleTime);
+				lights[NUM_LIGHT + i * 2 + 1].setBrightnessSmooth(rightsForLights[i], sampleTime);
+			}
 
-			// we only send the sum if outputs are not connected
-			expanderMessage->leftSum = chainActive ? leftSum : 0.f;
-			expanderMessage->rightSum = chainActive ? rightSum : 0.f;
-			expanderMessage->chainActive = chainActive;
+			sumTelemetry.push(sumLevels.getFrame(sampleTime));
 
-			rightModule->getLeftExpander().requestMessageFlip();
+			leftStripLevels.reset();
+			rightStripLevels.reset();
+			sumLevels.reset();
 		}
 	}
 
@@ -199,6 +260,7 @@ struct Hive : Module {
 		json_t* rootJ = json_object();
 		json_object_set_new(rootJ, "clipOutput", json_boolean(clipOutput));
 		json_object_set_new(rootJ, "acCoupling", json_boolean(acCoupling));
+		json_object_set_new(rootJ, "antialiasClipping", json_boolean(antialiasClipping));
 		return rootJ;
 	}
 
@@ -212,11 +274,18 @@ struct Hive : Module {
 		if (acCouplingJ) {
 			acCoupling = json_is_true(acCouplingJ);
 		}
+
+		json_t* antialiasClippingJ = json_object_get(rootJ, "antialiasClipping");
+		if (antialiasClippingJ) {
+			antialiasClipping = json_is_true(antialiasClippingJ);
+		}
 	}
 };
 
 
 struct HiveWidget : ModuleWidget {
+	dsp::VuMeter2 leftMeter, rightMeter;
+
 	HiveWidget(Hive* module) {
 		setModule(module);
 		setPanel(createPanel(asset::plugin(pluginInstance, "res/panels/Hive.svg")));
@@ -257,6 +326,40 @@ struct HiveWidget : ModuleWidget {
 		addChild(createLightCentered<SmallLight<RedLight>>(mm2px(Vec(34.31, 107.578)), module, Hive::RIGHT_LIGHT));
 	}
 
+	void step() override {
+		Hive* hive = dynamic_cast<Hive*>(module);
+		if (hive) {
+			LevelFrame frame;
+			while (hive->sumTelemetry.pop(&frame)) {
+				const float_4 peaks = frame.getPeak();
+				leftMeter.process(frame.deltaTime, peaks[0] / 8.f);
+				rightMeter.process(frame.deltaTime, peaks[1] / 8.f);
+			}
+			hive->lights[Hive::LEFT_LIGHT].setBrightness(leftMeter.getBrightness(-3.0f, 0.f));
+			hive->lights[Hive::RIGHT_LIGHT].setBrightness(rightMeter.getBrightness(-3.0f, 0.f));
+		}
+
+		ModuleWidget::step();
+	}
+
+	void startRecording(Hive* hive) {
+		osdialog_filters* filters = osdialog_filters_parse("WAV:wav");
+		char* pathC = osdialog_file(OSDIALOG_SAVE, NULL, "Hive.wav", filters);
+		osdialog_filters_free(filters);
+		if (!pathC) {
+			return;
+		}
+		std::string path = pathC;
+		std::free(pathC);
+
+		if (system::getExtension(path) != ".wav") {
+			path += ".wav";
+		}
+		if (!hive->recorder.start(path, APP->engine->getSampleRate())) {
+			WARN("Hive could not open %s for recording", path.c_str());
+		}
+	}
+
 	void appendContextMenu(Menu* menu) override {
 		Hive* hive = dynamic_cast<Hive*>(module);
 		assert(hive);
@@ -269,6 +372,33 @@ struct HiveWidget : ModuleWidget {
 			menu->addChild(createBoolPtrMenuItem("AC coupling", "", &hive->acCoupling));
 			menu->addChild(createBoolPtrMenuItem("Clip Output ±10V", "", &hive->clipOutput));
 		}));
+		menu->addChild(createBoolPtrMenuItem("Anti-aliased clipping", "", &hive->antialiasClipping));
+
+		menu->addChild(new MenuSeparator());
+		const int overruns = hive->recorder.getOverruns();
+		if (hive->recorder.isRecording()) {
+			menu->addChild(createMenuLabel(string::f("Recording, %.0f s, %d overruns", hive->recorder.getDuration(), overruns)));
+			menu->addChild(createMenuItem("Stop recording", "", [ = ]() {
+				hive->recorder.stop();
+			}));
+		}
+		else {
+			menu->addChild(createMenuItem("Record output to WAV...", "", [ = ]() {
+				startRecording(hive);
+			}));
+			if (hive->recorder.getStopReason() == WavRecorder::SAMPLE_RATE_CHANGED) {
+				menu->addChild(createMenuLabel("Last recording stopped when the sample rate changed"));
+			}
+			else if (hive->recorder.getStopReason() == WavRecorder::SIZE_LIMIT_REACHED) {
+				menu->addChild(createMenuLabel("Last recording stopped at the 4 GB limit"));
+			}
+			else if (hive->recorder.getStopReason() == WavRecorder::WRITE_FAILED) {
+				menu->addChild(createMenuLabel(string::f("Last recording stopped on a failed write (%d errors)", hive->recorder.getWriteErrors())));
+			}
+			if (overruns > 0) {
+				menu->addChild(createMenuLabel(string::f("Last recording had %d overruns", overruns)));
+			}
+		}
 
 		// label to indicate expander chaining
 		if (hive->expanderActive) {
@@ -29,6 +29,11 @@ struct Path : Module {
 	};
 
 	dsp::ClockDivider lightDivider;
+	// see RouteAntialiaser
+	bool antialiasRoute = false;
+	RouteAntialiaser routeAntialiasers[4];
+	// the last sample of each group of voices, as the antialiasers' gains are a sample late
+	float_4 previousSignals[4] = {};
 
 	Path() {
 		config(PARAMS_LEN, INPUTS_LEN, OUTPUTS_LEN, LIGHTS_LEN);
@@ -50,16 +55,38 @@ struct Path : Module {
 
 	void process(const ProcessArgs& args) override {
 
-		const float routeCv = params[ROUTE_CV_PARAM].getValue() * inputs[ROUTE_INPUT].getVoltage() / 5.f * (params[PLUS_MINUS_PARAM].getValue() == 0.f ? 1.f : -1.f);
-		const float routeValue = clamp(params[ROUTE_PARAM].getValue() + routeCv, 0.f, 1.f);
-
-		float_4 outGains = gainsForChannels(routeValue);
-
-		float in = inputs[IN_INPUT].getNormalVoltage(10.f);
-		outputs[OUT1_OUTPUT].setVoltage(in * outGains[0]);
-		outputs[OUT2_OUTPUT].setVoltage(in * outGains[1]);
-		outputs[OUT3_OUTPUT].setVoltage(in * outGains[2]);
-		outputs[OUT4_OUTPUT].setVoltage(in * outGains[3]);
+		const float routeCvGain = params[ROUTE_CV_PARAM].getValue() / 5.f * (params[PLUS_MINUS_PARAM].getValue() == 0.f ? 1.f : -1.f);
+		const float routeParam = params[ROUTE_PARAM].getValue();
+
+		// each voice of the signal has its own route, a mono signal or CV applies to all voices
+		Input& in = inputs[IN_INPUT];
+		Input& routeIn = inputs[ROUTE_INPUT];
+		const int channels = std::max({in.getChannels(), routeIn.getChannels(), 1});
+
+		// LEDs show the highest gain of any voice
+		float_4 outGains = 0.f;
+		for (int c = 0; c < channels; c += 4) {
+			const float_4 routeValues = simd::clamp(routeParam + routeCvGain * getPolyVoicesSimd(routeIn, c), 0.f, 1.f);
+			float_4 voiceGains[4];
+			if (antialiasRoute) {
+				routeAntialiasers[c / 4].process(routeValues, voiceGains);
+			}
+			else {
+				gainsForChannels(routeValues, voiceGains);
+			}
+
+			const float_4 input = in.isConnected() ? getPolyVoicesSimd(in, c) : 10.f;
+			const float_4 signal = antialiasRoute ? previousSignals[c / 4] : input;
+			previousSignals[c / 4] = input;
+			const float_4 mask = voiceMask(c, channels);
+			for (int k = 0; k < 4; k++) {
+				outputs[OUT1_OUTPUT + k].setVoltageSimd(signal * voiceGains[k], c);
+				outGains[k] = std::max(outGains[k], horizontalMax(simd::ifelse(mask, voiceGains[k], 0.f)));
+			}
+		}
+		for (int k = 0; k < 4; k++) {
+			outputs[OUT1_OUTPUT + k].setChannels(channels);
+		}
 
 		if (lightDivider.process()) {
 			const float sampleTime = args.sampleTime * lightUpdateRate;
@@ -70,6 +97,19 @@ struct Path : Module {
 			lights[NUM4_LIGHT].setBrightnessSmooth(outGains[3], sampleTime, lambda);
 		}
 	}
+
+	json_t* dataToJson() override {
+		json_t* rootJ = json_object();
+		json_object_set_new(rootJ, "antialiasRoute", json_boolean(antialiasRoute));
+		return rootJ;
+	}
+
+	void dataFromJson(json_t* rootJ) override {
+		json_t* antialiasRouteJ = json_object_get(rootJ, "antialiasRoute");
+		if (antialiasRouteJ) {
+			antialiasRoute = json_boolean_value(antialiasRouteJ);
+		}
+	}
 };
 
 
@@ -99,6 +139,13 @@ struct PathWidget : ModuleWidget {
 		addChild(createLight<VostokWhiteNumberLed<4>>(mm2px(Vec(12.560, 52.488)), module, Path::NUM4_LIGHT));
 
 	}
+
+	void appendContextMenu(Menu* menu) override {
+		Path* path = dynamic_cast<Path*>(module);
+		assert(path);
+		menu->addChild(new MenuSeparator());
+		menu->addChild(createBoolPtrMenuItem("Anti-alias audio-rate route CV", "1 sample latency", &path->antialiasRoute));
+	}
 };
 
 
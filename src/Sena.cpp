@@ -1,4 +1,5 @@
 #include "plugin.hpp"
+#include "FastMath.hpp"
 #include "ChowDSP.hpp"
 #include <array>
 
@@ -215,6 +216,8 @@ struct Sena : Module {
 	bool useAdaa = true; // default is to use antiderivative antialiasing
 	dsp::ClockDivider lightDivider;
 	bool removePulseDC = true;
+	// engine sample rate, as of the last SampleRateChangeEvent
+	float sampleRate = 44100.f;
 
 	FoldStage1 stage1;
 	FoldStage2 stage2;
@@ -309,9 +312,13 @@ struct Sena : Module {
 		lightDivider.setDivision(lightUpdateRate);
 	}
 
-	void onSampleRateChange() override {
-		float sampleRate = APP->engine->getSampleRate();
+	void onSampleRateChange(const SampleRateChangeEvent& e) override {
+		sampleRate = e.sampleRate;
+		applySampleRate();
+	}
 
+	// (re)configures everything that depends on the sample rate or the oversampling index
+	void applySampleRate() {
 		oversamplerFM.setOversamplingIndex(oversamplingIndex);
 		oversamplerFM.reset(sampleRate);
 
@@ -526,7 +533,7 @@ struct Sena : Module {
 			// Blue noise: 3dB/oct
 			if (outputs[BLUE_OUTPUT].isConnected()) {
 				// apply a +6dB/oct filter to the pink noise (which is -3dB/oct) to get a +3dB/oct blue noise
-				float blue = (pink - lastPink) * 0.25f * (APP->engine->getSampleRate() / 44100.f);
+				float blue = (pink - lastPink) * 0.25f * (sampleRate / 44100.f);
 				lastPink = pink;
 				outputs[BLUE_OUTPUT].setVoltage(blue);
 			}
@@ -611,13 +618,13 @@ struct Sena : Module {
 			// pitch is v/oct (if mode is selected) + frequency pot value
 			const float_4 pitch = simd::ifelse(isLinearFm, float_4::zero(), fmInputs) + frequencyPotsPitch;
 			// convert to frequency in Hz
-			const float_4 freq = simd::pow(2.f, pitch) + 120 * simd::ifelse(isLinearFm, fmInputs, float_4::zero());
+			const float_4 freq = fastExp2(pitch) + 120 * simd::ifelse(isLinearFm, fmInputs, float_4::zero());
 
 			oversamplerFM.upsample(freq);
 		}
 		else {
 			// if no CVs are connected, just use the frequency pots
-			std::fill(osBufferFM, &osBufferFM[oversamplingRatio], simd::pow(2.f, frequencyPotsPitch));
+			std::fill(osBufferFM, &osBufferFM[oversamplingRatio], fastExp2(frequencyPotsPitch));
 		}
 
 
@@ -674,7 +681,7 @@ struct Sena : Module {
 		json_t* jOversamplingIndex = json_object_get(rootJ, "oversamplingIndex");
 		if (jOversamplingIndex) {
 			oversamplingIndex = json_integer_value(jOversamplingIndex);
-			onSampleRateChange();
+			applySampleRate();
 		}
 
 		json_t* jUseAdaa = json_object_get(rootJ, "useAdaa");
@@ -746,7 +753,7 @@ struct SenaWidget : ModuleWidget {
 			},
 			[ = ](int mode) {
 				module->oversamplingIndex = mode;
-				module->onSampleRateChange();
+				module->applySampleRate();
 			}));
 
 			menu->addChild(createBoolPtrMenuItem("Use ADAA", "", &module->useAdaa));
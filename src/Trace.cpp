@@ -30,6 +30,11 @@ struct Trace : Module {
 
 	bool clipOutput = true;
 	dsp::ClockDivider lightDivider;
+	// see RouteAntialiaser
+	bool antialiasScan = false;
+	RouteAntialiaser scanAntialiasers[4];
+	// the last sample of each input's groups of voices, as the antialiasers' gains are a sample late
+	float_4 previousInputs[4][4] = {};
 
 	Trace() {
 		config(PARAMS_LEN, INPUTS_LEN, OUTPUTS_LEN, LIGHTS_LEN);
@@ -53,10 +58,43 @@ struct Trace : Module {
 
 	void process(const ProcessArgs& args) override {
 
-		const float scanCv = params[SCAN_CV_PARAM].getValue() * inputs[SCAN_INPUT].getVoltage() / 5.f * (params[PLUS_MINUS_PARAM].getValue() == 0.f ? 1.f : -1.f);
-		const float scanValue = clamp(params[SCAN_PARAM].getValue() + scanCv, 0.f, 1.f);
+		const float scanCvGain = params[SCAN_CV_PARAM].getValue() / 5.f * (params[PLUS_MINUS_PARAM].getValue() == 0.f ? 1.f : -1.f);
+		const float scanParam = params[SCAN_PARAM].getValue();
 
-		float_4 inGain = gainsForChannels(scanValue);
+		// each voice has its own scan position, mono inputs or CV apply to all voices
+		Input& scanIn = inputs[SCAN_INPUT];
+		int channels = std::max(scanIn.getChannels(), 1);
+		for (int k = 0; k < 4; k++) {
+			channels = std::max(channels, inputs[IN1_INPUT + k].getChannels());
+		}
+
+		// LEDs show the highest gain of any voice
+		float_4 inGain = 0.f;
+		for (int c = 0; c < channels; c += 4) {
+			const float_4 scanValues = simd::clamp(scanParam + scanCvGain * getPolyVoicesSimd(scanIn, c), 0.f, 1.f);
+			float_4 voiceGains[4];
+			if (antialiasScan) {
+				scanAntialiasers[c / 4].process(scanValues, voiceGains);
+			}
+			else {
+				gainsForChannels(scanValues, voiceGains);
+			}
+
+			float_4 out = 0.f;
+			const float_4 mask = voiceMask(c, channels);
+			for (int k = 0; k < 4; k++) {
+				const float_4 input = getPolyVoicesSimd(inputs[IN1_INPUT + k], c);
+				out += (antialiasScan ? previousInputs[k][c / 4] : input) * voiceGains[k];
+				previousInputs[k][c / 4] = input;
+				inGain[k] = std::max(inGain[k], horizontalMax(simd::ifelse(mask, voiceGains[k], 0.f)));
+			}
+
+			if (clipOutput) {
+				out = simd::clamp(out, -10.f, 10.f);
+			}
+			outputs[OUT_OUTPUT].setVoltageSimd(out, c);
+		}
+		outputs[OUT_OUTPUT].setChannels(channels);
 
 		if (lightDivider.process()) {
 			const float sampleTime = args.sampleTime * lightUpdateRate;
@@ -65,22 +103,12 @@ struct Trace : Module {
 			lights[NUM3_LIGHT].setBrightnessSmooth(inGain[2], sampleTime, lambda);
 			lights[NUM4_LIGHT].setBrightnessSmooth(inGain[3], sampleTime, lambda);
 		}
-
-		float out = inputs[IN1_INPUT].getVoltage() * inGain[0] +
-		            inputs[IN2_INPUT].getVoltage() * inGain[1] +
-		            inputs[IN3_INPUT].getVoltage() * inGain[2] +
-		            inputs[IN4_INPUT].getVoltage() * inGain[3];
-
-		if (clipOutput) {
-			out = clamp(out, -10.f, 10.f);
-		}
-
-		outputs[OUT_OUTPUT].setVoltage(out);
 	}
 
 	json_t* dataToJson() override {
 		json_t* rootJ = json_object();
 		json_object_set_new(rootJ, "clipOutput", json_boolean(clipOutput));
+		json_object_set_new(rootJ, "antialiasScan", json_boolean(antialiasScan));
 		return rootJ;
 	}
 
@@ -89,6 +117,11 @@ struct Trace : Module {
 		if (clipOutputJ) {
 			clipOutput = json_boolean_value(clipOutputJ);
 		}
+
+		json_t* antialiasScanJ = json_object_get(rootJ, "antialiasScan");
+		if (antialiasScanJ) {
+			antialiasScan = json_boolean_value(antialiasScanJ);
+		}
 	}
 };
 
@@ -124,6 +157,7 @@ struct TraceWidget : ModuleWidget {
 		Trace* trace = dynamic_cast<Trace*>(module);
 		assert(trace);
 		menu->addChild(createBoolPtrMenuItem("Clip Output ±10V", "", &trace->clipOutput));
+		menu->addChild(createBoolPtrMenuItem("Anti-alias audio-rate scan CV", "1 sample latency", &trace->antialiasScan));
 	}
 };
 
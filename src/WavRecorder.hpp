@@ -0,0 +1,245 @@
+#pragma once
+#include <rack.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+
+
+/** Records a stereo signal to a 32-bit float WAV file.
+
+The audio thread only calls push(), which copies a frame into a preallocated lock-free ring and
+never touches the file. A writer thread drains the ring in large blocks through a buffered FILE.
+If it can't keep up the ring fills, and the frames that don't fit are counted as overruns rather
+than blocking the audio thread. start() and stop() open the file and wait for the writer, so call
+them from the UI thread; end() can be called from any thread, and the writer then finalises the
+file itself. A WAV file has a single sample rate and 32-bit sizes, so recordings end when the
+engine's rate changes (see end()) or at 4 GB (about 3 hours at 48 kHz). A write that fails, e.g.
+on a full disk, ends the recording too, and the header then covers only the frames that reached
+the file. getStopReason() says which.
+*/
+struct WavRecorder {
+	// about 1.4 s at 48 kHz
+	static const size_t ringFrames = 1 << 16;
+	static const size_t writeFrames = 4096;
+	static const size_t fileBufferSize = 1 << 20;
+	static const uint32_t maxFrames = (UINT32_MAX - 64) / (2 * sizeof(float));
+
+	struct StereoFrame {
+		float left;
+		float right;
+	};
+
+	enum StopReason {
+		STOPPED_BY_USER,
+		SAMPLE_RATE_CHANGED,
+		SIZE_LIMIT_REACHED,
+		WRITE_FAILED,
+	};
+
+	~WavRecorder() {
+		stop();
+	}
+
+	bool start(const std::string& path, int sampleRate) {
+		stop();
+
+		file = std::fopen(path.c_str(), "wb");
+		if (!file) {
+			return false;
+		}
+		std::setvbuf(file, nullptr, _IOFBF, fileBufferSize);
+		this->path = path;
+
+		// sizes are filled in by the writer once the recording ends
+		framesWritten = 0;
+		writeErrors = 0;
+		this->sampleRate = sampleRate;
+		if (!writeHeader()) {
+			std::fclose(file);
+			file = nullptr;
+			return false;
+		}
+
+		if (!ring) {
+			ring.reset(new dsp::RingBuffer<StereoFrame, ringFrames>);
+		}
+		ring->clear();
+		overruns = 0;
+		stopReason = STOPPED_BY_USER;
+
+		recording = true;
+		writer = std::thread(&WavRecorder::write, this);
+		return true;
+	}
+
+	// ends the recording, and waits for the file to be finalised
+	void stop() {
+		end(STOPPED_BY_USER);
+		if (writer.joinable()) {
+			writer.join();
+		}
+	}
+
+	// Ends the recording without waiting, so it's real-time safe: push() stops recording, and the
+	// writer writes the frames already pushed and finalises the file. Joined by stop() or start().
+	void end(StopReason reason) {
+		bool wasRecording = true;
+		if (recording.compare_exchange_strong(wasRecording, false)) {
+			stopReason = reason;
+		}
+	}
+
+	bool isRecording() const {
+		return recording;
+	}
+
+	// audio thread
+	void push(float left, float right) {
+		if (!recording) {
+			return;
+		}
+		if (ring->full()) {
+			overruns++;
+			return;
+		}
+		ring->push({left, right});
+	}
+
+	// frames dropped because the writer fell behind
+	int getOverruns() const {
+		return overruns;
+	}
+
+	// failed writes, seeks and closes, see WRITE_FAILED
+	int getWriteErrors() const {
+		return writeErrors;
+	}
+
+	float getDuration() const {
+		return sampleRate > 0 ? (float) framesWritten / sampleRate : 0.f;
+	}
+
+	// the rate the file is labelled with
+	int getSampleRate() const {
+		return sampleRate;
+	}
+
+	// why the last recording ended
+	StopReason getStopReason() const {
+		return stopReason;
+	}
+
+private:
+	// the ring is kept (and reused) after stop(), as a push() may still be running on the audio thread
+	std::unique_ptr<dsp::RingBuffer<StereoFrame, ringFrames>> ring;
+	std::atomic<bool> recording{false};
+	std::atomic<int> overruns{0};
+	std::atomic<int> writeErrors{0};
+	std::atomic<uint32_t> framesWritten{0};
+	std::atomic<StopReason> stopReason{STOPPED_BY_USER};
+	std::thread writer;
+	FILE* file = nullptr;
+	std::string path;
+	int sampleRate = 0;
+
+	// 32-bit float WAV header (little-endian platforms only)
+	struct WavHeader {
+		char riff[4] = {'R', 'I', 'F', 'F'};
+		uint32_t riffSize;
+		char wave[4] = {'W', 'A', 'V', 'E'};
+		char fmt[4] = {'f', 'm', 't', ' '};
+		uint32_t fmtSize = 18;
+		uint16_t formatTag = 3;  // WAVE_FORMAT_IEEE_FLOAT
+		uint16_t channels;
+		uint32_t sampleRate;
+		uint32_t byteRate;
+		uint16_t blockAlign;
+		uint16_t bitsPerSample = 32;
+		uint16_t extensionSize = 0;
+		// non-PCM formats need a fact chunk
+		char fact[4] = {'f', 'a', 'c', 't'};
+		uint32_t factSize = 4;
+		uint32_t sampleLength;
+		char data[4] = {'d', 'a', 't', 'a'};
+		uint32_t dataSize;
+	} __attribute__((packed));
+
+	void write() {
+		StereoFrame block[writeFrames];
+		bool failed = false;
+		// keep going after stop() until the frames already pushed are written, or just drained once
+		// a write has failed
+		while (recording || !ring->empty()) {
+			size_t n = 0;
+			while (n < writeFrames && !ring->empty()) {
+				block[n++] = ring->shift();
+			}
+
+			if (n == 0) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(10));
+				continue;
+			}
+			if (failed) {
+				continue;
+			}
+
+			// the frames past the limit are dropped along with the rest of the ring
+			const size_t space = maxFrames - framesWritten;
+			if (n > space) {
+				n = space;
+				end(SIZE_LIMIT_REACHED);
+			}
+			const size_t written = std::fwrite(block, sizeof(StereoFrame), n, file);
+			framesWritten += written;
+			if (written < n) {
+				fail();
+				failed = true;
+			}
+		}
+
+		// frames still in the FILE's buffer may fail to reach the file, in which case only the
+		// frames that did are counted
+		if (std::fflush(file) != 0) {
+			fail();
+			const int64_t dataBytes = system::getFileSize(path) - (int64_t) sizeof(WavHeader);
+			const int64_t framesInFile = std::max(dataBytes, (int64_t) 0) / (int64_t) sizeof(StereoFrame);
+			framesWritten = std::min(framesInFile, (int64_t) framesWritten);
+		}
+		if (!writeHeader()) {
+			fail();
+		}
+		if (std::fclose(file) != 0) {
+			fail();
+		}
+		file = nullptr;
+	}
+
+	// writer thread, the recording ends whatever the reason it was going to end for
+	void fail() {
+		writeErrors++;
+		recording = false;
+		stopReason = WRITE_FAILED;
+	}
+
+	// writes the header with the chunk sizes for framesWritten, returns false if that failed
+	bool writeHeader() {
+		const uint32_t numChannels = 2;
+		const uint32_t bytesPerFrame = numChannels * sizeof(float);
+		const uint32_t dataSize = framesWritten * bytesPerFrame;
+
+		WavHeader header;
+		header.riffSize = sizeof(header) - 8 + dataSize;
+		header.channels = numChannels;
+		header.sampleRate = sampleRate;
+		header.byteRate = sampleRate * bytesPerFrame;
+		header.blockAlign = bytesPerFrame;
+		header.sampleLength = framesWritten;
+		header.dataSize = dataSize;
+
+		return std::fseek(file, 0, SEEK_SET) == 0
+		       && std::fwrite(&header, sizeof(header), 1, file) == 1
+		       && std::fseek(file, 0, SEEK_END) == 0;
+	}
+};
@@ -0,0 +1,90 @@
+#pragma once
+#include <rack.hpp>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <thread>
+#include <vector>
+#if defined(__x86_64__) || defined(_M_X64)
+#include <xmmintrin.h>
+#endif
+
+
+/** A few threads that a module can hand part of its DSP to.
+
+Each thread repeatedly calls work(index), which should poll its single-producer/single-consumer
+rings from the module (e.g. dsp::RingBuffer) and return whether it found anything to do. Nothing
+here ever blocks the audio thread. Rack runs process() in bursts, one audio buffer at a time, so
+idle threads keep spinning and yielding for longer than any buffer period before backing off to
+short sleeps. As a thread may be asleep, or not scheduled at all, the module should never wait for
+its results, but make do without results that aren't back in time (see Atlas).
+Threads are started from the UI thread and run until stop() or destruction. isRunning() stays true
+until they have been joined, so once it's false the module may take back what it handed to them.
+*/
+struct WorkerPool {
+	static const int spinIterations = 1000;
+	static constexpr std::chrono::milliseconds yieldTime{50};
+	static constexpr std::chrono::microseconds sleepTime{100};
+
+	~WorkerPool() {
+		stop();
+	}
+
+	void start(int numThreads, std::function<bool(int)> work) {
+		if (running) {
+			return;
+		}
+		this->work = work;
+		stopping = false;
+		running = true;
+		for (int i = 0; i < numThreads; i++) {
+			threads.emplace_back(&WorkerPool::run, this, i);
+		}
+	}
+
+	void stop() {
+		stopping = true;
+		for (std::thread& thread : threads) {
+			thread.join();
+		}
+		threads.clear();
+		running = false;
+	}
+
+	bool isRunning() const {
+		return running;
+	}
+
+private:
+	std::vector<std::thread> threads;
+	std::atomic<bool> running{false};
+	std::atomic<bool> stopping{false};
+	std::function<bool(int)> work;
+
+	void run(int index) {
+		system::setThreadName(string::f("Vostok worker %d", index));
+#if defined(__x86_64__) || defined(_M_X64)
+		// flush denormals to zero, as Rack's engine threads do
+		_mm_setcsr(_mm_getcsr() | 0x8040);
+#endif
+
+		int idle = 0;
+		std::chrono::steady_clock::time_point idleStart;
+		while (!stopping) {
+			if (work(index)) {
+				idle = 0;
+			}
+			else if (idle < spinIterations) {
+				if (++idle == spinIterations) {
+					idleStart = std::chrono::steady_clock::now();
+				}
+			}
+			else if (std::chrono::steady_clock::now() - idleStart < yieldTime) {
+				std::this_thread::yield();
+			}
+			else {
+				std::this_thread::sleep_for(sleepTime);
+			}
+		}
+	}
+};
@@ -0,0 +1,14 @@
+#include "Kernels.hpp"
+
+
+const Kernels* kernels = &kernelsSSE;
+
+
+void initKernels() {
+	kernels = &kernelsSSE;
+#if defined(__x86_64__) || defined(_M_X64)
+	if (kernelsAVX2 && __builtin_cpu_supports("avx2")) {
+		kernels = kernelsAVX2;
+	}
+#endif
+}
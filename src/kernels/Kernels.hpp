@@ -0,0 +1,50 @@
+#pragma once
+
+
+/** Hot loops built once per instruction set, and chosen at runtime.
+
+The plugin is built for Rack's SSE baseline. Each file in src/kernels/ provides the same table of
+functions for one instruction set, and only that file gets the flags for it (see the Makefile),
+so the rest of the plugin, and the machines it runs on, are unaffected. initKernels(), called
+from init(), points `kernels` at the widest table the CPU supports.
+
+Kernels only see plain arrays, so that the wider variants need nothing from Rack's SDK. Every
+variant gives bit-identical results, so that a patch sounds the same on any machine: the same
+operations in the same order, with no fused multiply-adds (bench/Kernels.cpp checks this).
+
+Only loops with eight or more independent lanes per sample gain from AVX2, which so far is Hive's
+pan and sum over up to 16 voices per strip. Atlas's engines, the Ripples cores and Sena's
+oscillators and oversamplers each carry float_4 state from one (oversampled) sample to the next,
+so they stay on the baseline until they're restructured to run two such states side by side.
+*/
+
+// the voices of one of Hive's channel strips
+struct StripVoices {
+	// voltages of 16 voices each, as in a Port, valid up to the channel counts
+	const float* left;
+	const float* right;
+	const float* panCv;
+	int leftChannels;
+	int rightChannels;
+	// pan CV applies to every voice
+	bool panCvMonophonic;
+	float pan;
+	float gain;
+};
+
+struct Kernels {
+	const char* name;
+
+	// Hive: pans the voices of each of the four strips (with per-voice pan CV), and sums them
+	// times the strip gain
+	void (*panStrips)(const StripVoices strips[4], float leftSums[4], float rightSums[4]);
+};
+
+// Rack's baseline (SSE4.2 on x64), always available
+extern const Kernels kernelsSSE;
+// AVX2, or nullptr if this build has no x64 variant
+extern const Kernels* const kernelsAVX2;
+
+extern const Kernels* kernels;
+
+void initKernels();
@@ -0,0 +1,70 @@
+// Built with -mavx2 on x64 (see the Makefile). Only called once initKernels() has checked that the
+// CPU supports it. Not with -mfma, as the compiler would then fuse multiplies and adds, which
+// rounds differently from the SSE kernel.
+#include "Kernels.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#include <algorithm>
+
+
+// lanes for voices c to c + 7 that are below the channel count
+static inline __m256 voiceMask8(int c, int channels) {
+	const __m256 voices = _mm256_add_ps(_mm256_set1_ps(c), _mm256_setr_ps(0.f, 1.f, 2.f, 3.f, 4.f, 5.f, 6.f, 7.f));
+	return _mm256_cmp_ps(voices, _mm256_set1_ps(channels), _CMP_LT_OQ);
+}
+
+static inline __m256 clamp8(__m256 x, float a, float b) {
+	return _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(a)), _mm256_set1_ps(b));
+}
+
+// the lanes of x summed in order, as the SSE kernel does
+static inline float horizontalSum4(__m128 x) {
+	float lanes[4];
+	_mm_storeu_ps(lanes, x);
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+// As the SSE kernel, eight voices at a time. Each lane of the sums still takes the voices in the
+// SSE kernel's order (voices c to c + 3, then c + 4 to c + 7), so the results are bit-identical.
+static void panStrips(const StripVoices strips[4], float leftSums[4], float rightSums[4]) {
+	for (int i = 0; i < 4; ++i) {
+		const StripVoices& strip = strips[i];
+		const int channels = std::max(strip.leftChannels, strip.rightChannels);
+
+		__m128 leftVoices = _mm_setzero_ps();
+		__m128 rightVoices = _mm_setzero_ps();
+		for (int c = 0; c < channels; c += 8) {
+			const __m256 left = _mm256_and_ps(voiceMask8(c, strip.leftChannels), _mm256_loadu_ps(strip.left + c));
+			const __m256 right = _mm256_and_ps(voiceMask8(c, strip.rightChannels), _mm256_loadu_ps(strip.right + c));
+
+			const __m256 panCv = strip.panCvMonophonic ? _mm256_set1_ps(strip.panCv[0]) : _mm256_loadu_ps(strip.panCv + c);
+			const __m256 pan = clamp8(_mm256_add_ps(_mm256_set1_ps(strip.pan), _mm256_div_ps(panCv, _mm256_set1_ps(2.5f))), -1.f, 1.f);
+			const __m256 panLeft = clamp8(_mm256_sub_ps(_mm256_set1_ps(1.f), pan), 0.f, 1.f);
+			const __m256 panRight = clamp8(_mm256_add_ps(_mm256_set1_ps(1.f), pan), 0.f, 1.f);
+
+			// custom pan law, with  -1.5dB of center attenuation
+			const __m256 lefts = _mm256_mul_ps(_mm256_mul_ps(left, _mm256_sqrt_ps(panLeft)), panLeft);
+			const __m256 rights = _mm256_mul_ps(_mm256_mul_ps(right, _mm256_sqrt_ps(panRight)), panRight);
+			leftVoices = _mm_add_ps(_mm_add_ps(leftVoices, _mm256_castps256_ps128(lefts)), _mm256_extractf128_ps(lefts, 1));
+			rightVoices = _mm_add_ps(_mm_add_ps(rightVoices, _mm256_castps256_ps128(rights)), _mm256_extractf128_ps(rights, 1));
+		}
+
+		leftSums[i] = strip.gain * horizontalSum4(leftVoices);
+		rightSums[i] = strip.gain * horizontalSum4(rightVoices);
+	}
+}
+
+
+static const Kernels kernelsAVX2Table = {
+	"AVX2",
+	panStrips,
+};
+
+const Kernels* const kernelsAVX2 = &kernelsAVX2Table;
+
+#else
+
+const Kernels* const kernelsAVX2 = nullptr;
+
+#endif
@@ -0,0 +1,36 @@
+#include "../plugin.hpp"
+#include "../FastMath.hpp"
+#include "Kernels.hpp"
+
+
+static void panStrips(const StripVoices strips[4], float leftSums[4], float rightSums[4]) {
+	for (int i = 0; i < 4; ++i) {
+		const StripVoices& strip = strips[i];
+		const int channels = std::max(strip.leftChannels, strip.rightChannels);
+
+		float_4 leftVoices = 0.f;
+		float_4 rightVoices = 0.f;
+		for (int c = 0; c < channels; c += 4) {
+			const float_4 left = simd::ifelse(voiceMask(c, strip.leftChannels), float_4::load(strip.left + c), 0.f);
+			const float_4 right = simd::ifelse(voiceMask(c, strip.rightChannels), float_4::load(strip.right + c), 0.f);
+
+			const float_4 panCv = strip.panCvMonophonic ? float_4(strip.panCv[0]) : float_4::load(strip.panCv + c);
+			const float_4 pan = simd::clamp(strip.pan + panCv / 2.5f, -1.f, 1.f);
+			const float_4 panLeft = simd::clamp(1 - pan, 0.f, 1.f);
+			const float_4 panRight = simd::clamp(1 + pan, 0.f, 1.f);
+
+			// custom pan law, with  -1.5dB of center attenuation
+			leftVoices += left * fastSqrt(panLeft) * panLeft;
+			rightVoices += right * fastSqrt(panRight) * panRight;
+		}
+
+		leftSums[i] = strip.gain * (leftVoices[0] + leftVoices[1] + leftVoices[2] + leftVoices[3]);
+		rightSums[i] = strip.gain * (rightVoices[0] + rightVoices[1] + rightVoices[2] + rightVoices[3]);
+	}
+}
+
+
+const Kernels kernelsSSE = {
+	"SSE",
+	panStrips,
+};
@@ -1,4 +1,5 @@
 #include "plugin.hpp"
+#include "kernels/Kernels.hpp"
 
 
 Plugin* pluginInstance;
@@ -16,17 +17,12 @@ void init(Plugin* p) {
 	p->addModel(modelFuji);
 	p->addModel(modelSena);
 	p->addModel(modelHive);
+
+	// pick the widest kernels this CPU supports
+	initKernels();
+	// 2049 pow() calls, which don't belong in the first process() call
+	initCrossfadeTable();
 	
 	// Any other plugin initialization may go here.
 	// As an alternative, consider lazy-loading assets and lookup tables when your module is created to reduce startup times of Rack.
-}
-
-float_4 gainsForChannels(float routeValue) {
-	float_4 routeValueForChannel = (routeValue - crossfaderCentres / 5.f);
-	// channels 0 and 3 are special cases
-	routeValueForChannel = simd::clamp(routeValueForChannel, crossfaderMins, crossfaderMaxs);
-	// abs because we have a cubic
-	routeValueForChannel = simd::abs(routeValueForChannel);
-
-	return gains * simd::pow(2.0f, -routeValueForChannel * routeValueForChannel * routeValueForChannel * 290.f);
 }
\ No newline at end of file
@@ -316,14 +316,272 @@ const float_4 gains = float_4(0.89f, 0.865f, 0.865f, 0.89f);
 const float_4 crossfaderMins = float_4(0.0f, -10, -10, -10);
 const float_4 crossfaderMaxs = float_4(+10, +10, +10, 0.0f);
 
-float_4 gainsForChannels(float routeValue);
+// The crossfade law for route/scan values 0-1, giving the gain of each of the four channels
+inline float_4 crossfadeLaw(float routeValue) {
+	float_4 routeValueForChannel = (routeValue - crossfaderCentres / 5.f);
+	// channels 0 and 3 are special cases
+	routeValueForChannel = simd::clamp(routeValueForChannel, crossfaderMins, crossfaderMaxs);
+	// abs because we have a cubic
+	routeValueForChannel = simd::abs(routeValueForChannel);
+
+	return gains * simd::pow(2.0f, -routeValueForChannel * routeValueForChannel * routeValueForChannel * 290.f);
+}
+
+// crossfadeLaw() sampled over route values 0-1. With linear interpolation the gains are within
+// 2.1e-6 of crossfadeLaw() (see bench/CrossfadeLaw.cpp).
+struct CrossfadeTable {
+	static const int size = 2048;
+	float_4 gains[size + 1];
+
+	void build() {
+		for (int i = 0; i <= size; i++) {
+			gains[i] = crossfadeLaw((float) i / size);
+		}
+	}
+};
 
-// soft clip at +/- 10V
+// built by initCrossfadeTable(), from init(), rather than by the first module to process
+inline CrossfadeTable crossfadeTable;
+
+inline void initCrossfadeTable() {
+	crossfadeTable.build();
+}
+
+inline float_4 gainsForChannels(float routeValue) {
+	const CrossfadeTable& table = crossfadeTable;
+	// comparisons with NaN are false, so with the bound first std::max() takes NaN to 0 and the
+	// index stays in the table
+	const float index = std::min(std::max(0.f, routeValue), 1.f) * CrossfadeTable::size;
+	const int i = std::min((int) index, CrossfadeTable::size - 1);
+	return table.gains[i] + (table.gains[i + 1] - table.gains[i]) * (index - i);
+}
+
+// Gains for four voices at once, channelGains[k] holds channel k's gain for each voice. The same
+// lookup as above with the index arithmetic done across the voices: each voice loads its two
+// table rows, which are transposed to one vector per channel so as to interpolate all at once.
+inline void gainsForChannels(float_4 routeValues, float_4 channelGains[4]) {
+	const CrossfadeTable& table = crossfadeTable;
+	// as above, simd::clamp() takes NaN to the lower bound
+	const float_4 index = simd::clamp(routeValues, 0.f, 1.f) * CrossfadeTable::size;
+	const int32_4 i = simd::fmin(simd::floor(index), float_4(CrossfadeTable::size - 1));
+	const float_4 fraction = index - float_4(i);
+
+	float_4 lower[4], upper[4];
+	for (int v = 0; v < 4; v++) {
+		lower[v] = table.gains[i[v]];
+		upper[v] = table.gains[i[v] + 1];
+	}
+	_MM_TRANSPOSE4_PS(lower[0].v, lower[1].v, lower[2].v, lower[3].v);
+	_MM_TRANSPOSE4_PS(upper[0].v, upper[1].v, upper[2].v, upper[3].v);
+	for (int k = 0; k < 4; k++) {
+		channelGains[k] = lower[k] + (upper[k] - lower[k]) * fraction;
+	}
+}
+
+// soft clip at +/- 10V, for float or float_4
 template <typename T>
 static T clip4(T x) {
-	// Pade approximant of x/(1 + x^12)^(1/12)
+	// Pade approximant of x/(1 + x^12)^(1/12), in Horner form in x^12
 	const T limit = 1.16691853009184f;
 	x = clamp(x * 0.1f, -limit, limit);
-	return 10.0f * (x + 1.45833f * simd::pow(x, 13) + 0.559028f * simd::pow(x, 25) + 0.0427035f * simd::pow(x, 37))
-	       / (1.0f + 1.54167f * simd::pow(x, 12) + 0.642361f * simd::pow(x, 24) + 0.0579909f * simd::pow(x, 36));
-}
\ No newline at end of file
+	const T x2 = x * x;
+	const T x4 = x2 * x2;
+	const T x12 = x4 * x4 * x4;
+	const T numerator = x * (1.0f + x12 * (1.45833f + x12 * (0.559028f + x12 * 0.0427035f)));
+	const T denominator = 1.0f + x12 * (1.54167f + x12 * (0.642361f + x12 * 0.0579909f));
+	return 10.0f * numerator / denominator;
+}
+
+// clip4 with first-order antiderivative anti-aliasing, for signals that aren't oversampled. The
+// output is the mean of clip4 between consecutive inputs, found with 4-point Gauss-Legendre
+// quadrature rather than an antiderivative, so it needs no special case when they are close.
+// Being a two-point mean, it delays the signal by half a sample and rolls off the top octave
+// (-3 dB near 11 kHz at 44.1 kHz) even where clip4 is linear, so modules only use it as an
+// opt-in. processNaive() is plain clip4, keeping the state ready for a switch to process().
+template <typename T>
+struct Clip4ADAA {
+	T previous = 0.f;
+
+	void reset() {
+		previous = 0.f;
+	}
+
+	T process(T x) {
+		const T mid = 0.5f * (x + previous);
+		const T half = 0.5f * (x - previous);
+		previous = x;
+
+		// nodes +-0.33998 and +-0.86114, the weights are halved as they sum to 2
+		return 0.3260725774f * (clip4(mid - 0.3399810436f * half) + clip4(mid + 0.3399810436f * half))
+		       + 0.1739274226f * (clip4(mid - 0.8611363116f * half) + clip4(mid + 0.8611363116f * half));
+	}
+
+	T processNaive(T x) {
+		previous = x;
+		return clip4(x);
+	}
+};
+
+// lanes for voices c to c + 3 that are below the channel count
+inline float_4 voiceMask(int c, int channels) {
+	return float_4(c, c + 1, c + 2, c + 3) < channels;
+}
+
+// voices c to c + 3 of a polyphonic port, zero past its channel count
+inline float_4 getVoicesSimd(engine::Port& port, int c) {
+	return simd::ifelse(voiceMask(c, port.getChannels()), port.getVoltageSimd<float_4>(c), 0.f);
+}
+
+// as getVoicesSimd(), but a monophonic port applies to every voice
+inline float_4 getPolyVoicesSimd(engine::Port& port, int c) {
+	return port.isMonophonic() ? float_4(port.getVoltage()) : getVoicesSimd(port, c);
+}
+
+inline float horizontalMax(float_4 x) {
+	return std::max(std::max(x[0], x[1]), std::max(x[2], x[3]));
+}
+
+inline float horizontalMin(float_4 x) {
+	return std::min(std::min(x[0], x[1]), std::min(x[2], x[3]));
+}
+
+// Driven at audio rate, the sharp crossfade law acts as a waveshaper on the route CV and aliases.
+// This filters the gains with a triangular kernel over the last two samples, as the route values
+// move linearly from sample to sample, with one substep for every maxRouteStep of movement. The
+// kernel is centred on the previous sample, so modules delay their signal by a sample to match.
+// While the route moves less than maxRouteStep per sample there's nothing to speak of to alias,
+// and a single lookup at the previous sample's route stands in for the filter. The filter is
+// crossfaded in over routeCrossfadeSamples as soon as the route moves faster, and held for
+// routeFilterHoldSamples after that, so that it isn't dropped at every turn of an audio-rate CV.
+const float maxRouteStep = 0.01f;
+const int maxRouteSubsteps = 16;
+const int routeCrossfadeSamples = 32;
+const int routeFilterHoldSamples = 1024;
+
+struct RouteAntialiaser {
+	float_4 previousRouteValues[2] = {0.f, 0.f};
+	// 0 = single lookup, 1 = filter
+	float filterWeight = 0.f;
+	int filterHold = 0;
+
+	void process(float_4 routeValues, float_4 channelGains[4]) {
+		const float_4 points[3] = {previousRouteValues[1], previousRouteValues[0], routeValues};
+		previousRouteValues[1] = previousRouteValues[0];
+		previousRouteValues[0] = routeValues;
+
+		const float maxDelta = std::max(horizontalMax(simd::abs(points[1] - points[0])), horizontalMax(simd::abs(points[2] - points[1])));
+		if (maxDelta >= maxRouteStep) {
+			filterHold = routeFilterHoldSamples;
+		}
+		else if (filterHold > 0) {
+			filterHold--;
+		}
+		const float filterStep = 1.f / routeCrossfadeSamples;
+		filterWeight = (filterHold > 0) ? std::min(filterWeight + filterStep, 1.f) : std::max(filterWeight - filterStep, 0.f);
+
+		if (filterWeight < 1.f) {
+			gainsForChannels(points[1], channelGains);
+		}
+		if (filterWeight == 0.f) {
+			return;
+		}
+
+		float_4 filteredGains[4];
+		filterGains(points, maxDelta, filteredGains);
+		for (int k = 0; k < 4; k++) {
+			channelGains[k] = (filterWeight == 1.f) ? filteredGains[k] : channelGains[k] + (filteredGains[k] - channelGains[k]) * filterWeight;
+		}
+	}
+
+	static void filterGains(const float_4 points[3], float maxDelta, float_4 channelGains[4]) {
+		const int substeps = clamp((int) std::ceil(maxDelta / maxRouteStep), 1, maxRouteSubsteps);
+
+		for (int k = 0; k < 4; k++) {
+			channelGains[k] = 0.f;
+		}
+		// rising half of the kernel over the older segment, falling half over the newer one
+		for (int segment = 0; segment < 2; segment++) {
+			for (int j = 0; j < substeps; j++) {
+				const float t = (j + 0.5f) / substeps;
+				const float weight = (segment == 0 ? t : 1.f - t) / substeps;
+				float_4 substepGains[4];
+				gainsForChannels(points[segment] + (points[segment + 1] - points[segment]) * t, substepGains);
+				for (int k = 0; k < 4; k++) {
+					channelGains[k] += weight * substepGains[k];
+				}
+			}
+		}
+	}
+};
+
+// One window of levels from a PeakAccumulator, covering deltaTime seconds
+struct LevelFrame {
+	float_4 max;
+	float_4 min;
+	float_4 rms;
+	float deltaTime;
+
+	float_4 getPeak() const {
+		return simd::fmax(max, -min);
+	}
+};
+
+// Tracks the max, min and mean square of up to four signals between light updates, so that LEDs
+// updated every lightUpdateRate samples still catch transients shorter than that
+struct PeakAccumulator {
+	float_4 max = -INFINITY;
+	float_4 min = INFINITY;
+	float_4 sumSquares = 0.f;
+	int count = 0;
+
+	void process(float_4 x) {
+		max = simd::fmax(max, x);
+		min = simd::fmin(min, x);
+		sumSquares += x * x;
+		count++;
+	}
+
+	float_4 getPeak() const {
+		return simd::fmax(max, -min);
+	}
+
+	float_4 getRms() const {
+		return simd::sqrt(sumSquares / std::max(count, 1));
+	}
+
+	LevelFrame getFrame(float deltaTime) const {
+		return {max, min, getRms(), deltaTime};
+	}
+
+	// start a new window
+	void reset() {
+		max = -INFINITY;
+		min = INFINITY;
+		sumSquares = 0.f;
+		count = 0;
+	}
+};
+
+// Lock-free queue of telemetry (e.g. LevelFrames) from a module's process() to its widget, so that
+// analysis and smoothing for displays happens on the UI thread. If the widget falls behind, or
+// there is none, new frames are dropped rather than blocking the audio thread.
+template <typename T, size_t S = 1024>
+struct TelemetryRing {
+	dsp::RingBuffer<T, S> buffer;
+
+	// audio thread
+	void push(const T& t) {
+		if (!buffer.full()) {
+			buffer.push(t);
+		}
+	}
+
+	// UI thread, returns false once empty
+	bool pop(T* t) {
+		if (buffer.empty()) {
+			return false;
+		}
+		*t = buffer.shift();
+		return true;
+	}
+};
@@ -16,18 +16,209 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include "sos.hpp"
+#include "ellip.hpp"
 
 namespace ripples
 {
 
+// Anti-aliasing filter specification. These must match the cog script in
+// AAFilter below, which bakes coefficients for kAACommonRates.
+static const float kAAMinOversampledRate = 20000.f * 6;
+static const float kAAPassbandCorner = 20000.f; // Hz
+static const float kAAPassbandRipple = 0.1f; // dB
+static const float kAAStopbandAttenuation = 100.f; // dB
+static const float kAACommonRates[] =
+{
+    8000.f,
+    11025.f, 12000.f,
+    22050.f, 24000.f,
+    44100.f, 48000.f,
+    88200.f, 96000.f,
+    176400.f, 192000.f,
+    352800.f, 384000.f,
+    705600.f, 768000.f,
+};
+
+struct AAFilterDesign
+{
+    int oversampling_factor;
+    int num_sections;
+    SOSCoefficients sections[ellip::kMaxOrder / 2];
+};
+
+// Designs the anti-aliasing filter for an arbitrary rate, using the same
+// rules as the cog script
+inline void DesignAAFilter(float sample_rate, AAFilterDesign* design)
+{
+    int factor = std::ceil(kAAMinOversampledRate / sample_rate);
+    double wp = 2.0 * kAAPassbandCorner / (sample_rate * factor);
+    double ws = 1.0 / factor;
+
+    int order = ellip::Order(wp, ws, kAAPassbandRipple,
+        kAAStopbandAttenuation);
+    order = std::min(order, ellip::kMaxOrder);
+
+    // Round up to whole second-order sections, and keep some rolloff for
+    // rates that aren't oversampled
+    order = std::max(2, 2 * ((order + 1) / 2));
+
+    // DC gain is -rp for even-order filters, so amplify by rp
+    double dc_gain = std::pow(10.0, kAAPassbandRipple / 20.0);
+    ellip::DesignLowpass(order, kAAPassbandRipple, kAAStopbandAttenuation,
+        wp, dc_gain, design->sections);
+
+    design->oversampling_factor = factor;
+    design->num_sections = order / 2;
+}
+
+// Process-wide cache of runtime designs, keyed by sample rate. Designs are
+// computed on a background thread. Requesting one takes a lock and may
+// allocate (and the first request starts the thread), so requests are made
+// off the audio thread, which then only polls the entry's ready flag.
+class AAFilterCache
+{
+public:
+    struct Entry
+    {
+        float sample_rate;
+        std::atomic<bool> ready{false};
+        AAFilterDesign design;
+    };
+
+    static AAFilterCache& Instance()
+    {
+        static AAFilterCache cache;
+        return cache;
+    }
+
+    ~AAFilterCache()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        condition_.notify_one();
+        worker_.join();
+    }
+
+    // Returns the entry for sample_rate, queueing its design if it hasn't
+    // been requested before. Entries live as long as the cache.
+    const Entry* Request(float sample_rate)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::unique_ptr<Entry>& entry = entries_[sample_rate];
+        if (!entry)
+        {
+            entry.reset(new Entry);
+            entry->sample_rate = sample_rate;
+            queue_.push_back(entry.get());
+            condition_.notify_one();
+        }
+        return entry.get();
+    }
+
+protected:
+    std::mutex mutex_;
+    std::condition_variable condition_;
+    std::map<float, std::unique_ptr<Entry>> entries_;
+    std::deque<Entry*> queue_;
+    bool stop_ = false;
+    std::thread worker_;
+
+    AAFilterCache()
+    {
+        worker_ = std::thread(&AAFilterCache::Work, this);
+    }
+
+    void Work()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true)
+        {
+            condition_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+            if (stop_)
+            {
+                return;
+            }
+
+            Entry* entry = queue_.front();
+            queue_.pop_front();
+
+            lock.unlock();
+            DesignAAFilter(entry->sample_rate, &entry->design);
+            entry->ready.store(true, std::memory_order_release);
+            lock.lock();
+        }
+    }
+};
+
 template <typename T>
 class AAFilter
 {
 public:
-    void Init(float sample_rate)
+    // Returns the runtime design for sample_rate, or nullptr if the baked
+    // tables cover it. Not real-time safe, see AAFilterCache.
+    static const AAFilterCache::Entry* Request(float sample_rate)
+    {
+        if (sample_rate > kAACommonRates[0] && !IsCommonRate(sample_rate))
+        {
+            return AAFilterCache::Instance().Request(sample_rate);
+        }
+        return nullptr;
+    }
+
+    // Rates without baked coefficients use the next lower table until the
+    // design from Request() is ready. One that's ready already is used
+    // straight away.
+    void Init(float sample_rate, const AAFilterCache::Entry* design = nullptr)
     {
         InitFilter(sample_rate);
+
+        pending_ = design;
+        Update();
+    }
+
+    // Whether Update() has a design to switch to
+    bool IsUpdateReady() const
+    {
+        return pending_ != nullptr
+            && pending_->ready.load(std::memory_order_acquire);
+    }
+
+    // Switches to the runtime design once it's ready. Returns true if the
+    // filter, and possibly the oversampling factor, has changed. Switching
+    // clears the filter state, so callers should only do this where the
+    // filter holds no signal, or a click results.
+    bool Update()
+    {
+        if (!IsUpdateReady())
+        {
+            return false;
+        }
+
+        const AAFilterDesign& design = pending_->design;
+        pending_ = nullptr;
+
+        // Rates just around twice the passband corner need more sections
+        // than we have room for; keep the table for those
+        if (design.num_sections > kMaxNumSections)
+        {
+            return false;
+        }
+
+        up_filter_.Init(design.num_sections, design.sections);
+        down_filter_.Init(design.num_sections, design.sections);
+        oversampling_factor_ = design.oversampling_factor;
+        return true;
     }
 
     T ProcessUp(T in)
@@ -45,6 +236,12 @@ public:
         return oversampling_factor_;
     }
 
+    // Low-frequency delay through both filters, in oversampled samples
+    float GetGroupDelay() const
+    {
+        return up_filter_.GetGroupDelay() + down_filter_.GetGroupDelay();
+    }
+
 protected:
     struct CascadedSOS
     {
@@ -114,6 +311,19 @@ protected:
     SOSFilter<T, kMaxNumSections> up_filter_;
     SOSFilter<T, kMaxNumSections> down_filter_;
     int oversampling_factor_;
+    const AAFilterCache::Entry* pending_ = nullptr;
+
+    static bool IsCommonRate(float sample_rate)
+    {
+        for (float rate : kAACommonRates)
+        {
+            if (rate == sample_rate)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
 
     void InitFilter(float sample_rate)
     {
@@ -0,0 +1,284 @@
+// Runtime elliptic lowpass filter design
+// Copyright (C) 2025 Vostok Instruments
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with this program.  If not, see <https://www.gnu.org/licenses/>.
+
+#pragma once
+
+#include <cmath>
+#include <complex>
+#include <limits>
+#include "sos.hpp"
+
+// Follows scipy.signal's ellipord, ellip and zpk2sos, so that designs match
+// the tables baked into aafilter.hpp. The analog prototype is found with the
+// nome-based degree equation and Landen/AGM evaluation of the Jacobi elliptic
+// functions, as in S. J. Orfanidis, "Lecture Notes on Elliptic Filter Design".
+// Frequencies are normalised to Nyquist, as in scipy.
+
+namespace ripples
+{
+
+namespace ellip
+{
+
+typedef std::complex<double> Complex;
+
+static const int kMaxOrder = 32;
+
+// Complete elliptic integral of the first kind, K(m), taking the
+// complementary parameter mc = 1 - m to avoid cancellation near m = 1
+inline double EllipKc(double mc)
+{
+    double a = 1.0;
+    double b = std::sqrt(mc);
+
+    for (int i = 0; i < 32 && std::abs(a - b) > 1e-15 * a; i++)
+    {
+        double t = (a + b) / 2.0;
+        b = std::sqrt(a * b);
+        a = t;
+    }
+
+    return M_PI / (2.0 * a);
+}
+
+inline double EllipK(double m)
+{
+    return EllipKc(1.0 - m);
+}
+
+// Carlson's symmetric elliptic integral RF(x, y, z)
+inline double CarlsonRF(double x, double y, double z)
+{
+    for (int i = 0; i < 64; i++)
+    {
+        double mu = (x + y + z) / 3.0;
+        double dx = 1.0 - x / mu;
+        double dy = 1.0 - y / mu;
+        double dz = 1.0 - z / mu;
+
+        if (std::max(std::abs(dx), std::max(std::abs(dy), std::abs(dz)))
+            < 1e-4)
+        {
+            double e2 = dx * dy - dz * dz;
+            double e3 = dx * dy * dz;
+            return (1.0 - e2 / 10.0 + e3 / 14.0 + e2 * e2 / 24.0
+                - 3.0 * e2 * e3 / 44.0) / std::sqrt(mu);
+        }
+
+        double sx = std::sqrt(x);
+        double sy = std::sqrt(y);
+        double sz = std::sqrt(z);
+        double lambda = sx * sy + sy * sz + sz * sx;
+        x = (x + lambda) / 4.0;
+        y = (y + lambda) / 4.0;
+        z = (z + lambda) / 4.0;
+    }
+
+    return 1.0 / std::sqrt((x + y + z) / 3.0);
+}
+
+// Jacobi elliptic functions sn, cn and dn of real argument, found by the
+// descending Landen (AGM) transformation
+inline void EllipJ(double u, double m, double* sn, double* cn, double* dn)
+{
+    const int kMaxIterations = 16;
+    double a[kMaxIterations + 1];
+    double c[kMaxIterations + 1];
+
+    a[0] = 1.0;
+    c[0] = std::sqrt(m);
+    double b = std::sqrt(1.0 - m);
+    double two_n = 1.0;
+    int n = 0;
+
+    while (std::abs(c[n] / a[n]) > std::numeric_limits<double>::epsilon()
+        && n < kMaxIterations)
+    {
+        double an = a[n];
+        n++;
+        c[n] = (an - b) / 2.0;
+        a[n] = (an + b) / 2.0;
+        b = std::sqrt(an * b);
+        two_n *= 2.0;
+    }
+
+    double phi = two_n * a[n] * u;
+    double phi_prev = phi;
+    for (; n > 0; n--)
+    {
+        phi_prev = phi;
+        phi = (std::asin(c[n] * std::sin(phi) / a[n]) + phi) / 2.0;
+    }
+
+    *sn = std::sin(phi);
+    *cn = std::cos(phi);
+    *dn = *cn / std::cos(phi_prev - phi);
+}
+
+// Solves the degree equation N * K'(m) / K(m) = K'(m1) / K(m1) for m
+inline double EllipDeg(int order, double m1)
+{
+    const int kNumTerms = 7;
+
+    double q1 = std::exp(-M_PI * EllipKc(m1) / EllipK(m1));
+    double q = std::pow(q1, 1.0 / order);
+
+    double num = 0.0;
+    double den = 1.0;
+    for (int j = 0; j <= kNumTerms; j++)
+    {
+        num += std::pow(q, j * (j + 1));
+        den += 2.0 * std::pow(q, (j + 1) * (j + 1));
+    }
+
+    return 16.0 * q * std::pow(num / den, 4);
+}
+
+// Minimum order of a digital elliptic lowpass (wp < ws) or highpass
+// (wp > ws) meeting the given ripple and attenuation, as in ellipord
+inline int Order(double wp, double ws, double rp, double rs)
+{
+    double passb = std::tan(M_PI * wp / 2.0);
+    double stopb = std::tan(M_PI * std::min(ws, 1.0) / 2.0);
+    double nat = (wp < ws) ? stopb / passb : passb / stopb;
+
+    double gstop = std::pow(10.0, 0.1 * rs);
+    double gpass = std::pow(10.0, 0.1 * rp);
+    double arg1 = std::sqrt((gpass - 1.0) / (gstop - 1.0));
+    double arg0 = 1.0 / nat;
+
+    double m0 = arg0 * arg0;
+    double m1 = arg1 * arg1;
+    double ratio = EllipK(m0) * EllipKc(m1) / (EllipKc(m0) * EllipK(m1));
+
+    // Coincident band edges give an unbounded order
+    if (!(ratio < std::numeric_limits<int>::max()))
+    {
+        return std::numeric_limits<int>::max();
+    }
+
+    return static_cast<int>(std::ceil(ratio));
+}
+
+// Designs an even order digital elliptic lowpass with cutoff wn, passband
+// ripple rp (dB) and stopband attenuation rs (dB). The DC gain is scaled by
+// dc_gain. Writes order / 2 sections, ordered with the poles closest to the
+// unit circle last and the overall gain in the first section.
+inline void DesignLowpass(int order, double rp, double rs, double wn,
+    double dc_gain, SOSCoefficients* sections)
+{
+    int num_pairs = order / 2;
+
+    // Analog prototype with unit passband edge (ellipap)
+    double eps = std::sqrt(std::pow(10.0, 0.1 * rp) - 1.0);
+    double ck1 = eps / std::sqrt(std::pow(10.0, 0.1 * rs) - 1.0);
+    double m1 = ck1 * ck1;
+
+    double m = EllipDeg(order, m1);
+    double capk = EllipK(m);
+
+    // Solve 1 / eps = sc(r, 1 - m1) for r, i.e. r = F(atan(1 / eps) | 1 - m1)
+    double phi = std::atan(1.0 / eps);
+    double sphi = std::sin(phi);
+    double cphi = std::cos(phi);
+    double r = sphi * CarlsonRF(cphi * cphi, cphi * cphi + m1 * sphi * sphi,
+        1.0);
+    double v0 = capk * r / (order * EllipK(m1));
+
+    double sv, cv, dv;
+    EllipJ(v0, 1.0 - m, &sv, &cv, &dv);
+
+    // Prewarped cutoff for the bilinear transform at fs = 2
+    double warped = 4.0 * std::tan(M_PI * wn / 2.0);
+    const double fs2 = 4.0;
+
+    Complex zeros[kMaxOrder / 2];
+    Complex poles[kMaxOrder / 2];
+    Complex gain_num = 1.0;
+    Complex gain_den = 1.0;
+    Complex prototype_gain = 1.0;
+
+    for (int n = 0; n < num_pairs; n++)
+    {
+        double s, c, d;
+        EllipJ((2 * n + 1) * capk / order, m, &s, &c, &d);
+
+        Complex z(0.0, 1.0 / (std::sqrt(m) * s));
+        Complex p = -Complex(c * d * sv * cv, s * dv)
+            / (1.0 - (d * sv) * (d * sv));
+
+        // |p|^2 / |z|^2 for the conjugate pair
+        prototype_gain *= std::norm(p) / std::norm(z);
+
+        // Scale to the cutoff and map to the z-plane
+        z *= warped;
+        p *= warped;
+        gain_num *= (fs2 - z) * std::conj(fs2 - z);
+        gain_den *= (fs2 - p) * std::conj(fs2 - p);
+        zeros[n] = (fs2 + z) / (fs2 - z);
+        poles[n] = (fs2 + p) / (fs2 - p);
+    }
+
+    // Even order filters have a DC gain of -rp
+    double gain = prototype_gain.real() / std::sqrt(1.0 + eps * eps);
+    gain *= (gain_num / gain_den).real() * dc_gain;
+
+    // Pair each pole, starting with the one closest to the unit circle, with
+    // its nearest remaining zero (zpk2sos with nearest pairing), filling the
+    // sections from the back
+    bool pole_used[kMaxOrder / 2] = {};
+    bool zero_used[kMaxOrder / 2] = {};
+    for (int section = num_pairs - 1; section >= 0; section--)
+    {
+        int pi = -1;
+        for (int n = 0; n < num_pairs; n++)
+        {
+            if (!pole_used[n] && (pi < 0 || std::abs(1.0 - std::abs(poles[n]))
+                < std::abs(1.0 - std::abs(poles[pi]))))
+            {
+                pi = n;
+            }
+        }
+
+        int zi = -1;
+        for (int n = 0; n < num_pairs; n++)
+        {
+            if (!zero_used[n] && (zi < 0 || std::abs(zeros[n] - poles[pi])
+                < std::abs(zeros[zi] - poles[pi])))
+            {
+                zi = n;
+            }
+        }
+
+        pole_used[pi] = true;
+        zero_used[zi] = true;
+
+        SOSCoefficients& sos = sections[section];
+        sos.b[0] = 1.f;
+        sos.b[1] = -2.0 * zeros[zi].real();
+        sos.b[2] = std::norm(zeros[zi]);
+        sos.a[0] = -2.0 * poles[pi].real();
+        sos.a[1] = std::norm(poles[pi]);
+    }
+
+    sections[0].b[0] *= gain;
+    sections[0].b[1] *= gain;
+    sections[0].b[2] *= gain;
+}
+
+}
+
+}
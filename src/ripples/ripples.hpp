@@ -19,6 +19,7 @@
 #include <random>
 #include "rack.hpp"
 #include "aafilter.hpp"
+#include "../FastMath.hpp"
 
 using namespace rack;
 
@@ -113,11 +114,107 @@ static const float kVtoICollectorVSat = -10.f;
 // Opamp saturation voltage
 static const float kOpampSatV = 10.6f;
 
+// LM13700 OTA
+static const float kOTATemperature = 40.f; // Silicon temperature in Celsius
+static const float kKoverQ = 8.617333262145e-5;
+static const float kKelvin = 273.15f; // 0C in K
+static const float kOTAVt = kKoverQ * (kOTATemperature + kKelvin);
+
+// Model of Ripples nonlinear CV voltage-to-current converters
+inline float VtoIConverter(
+    float rfb,                          // Amplifier feedback resistor
+    float vc, float rc,                 // CV voltage and input resistor
+    float vp = 0.f, float rp = 1e12f)   // Knob voltage and resistor
+{
+    // Find nominal voltage at the BJT collector, ignoring nonlinearity
+    float vnom = -(vc * rfb / rc + vp * rfb / rp);
+
+    // Apply clipping - naive for now
+    float vout = std::max(vnom, kVtoICollectorVSat);
+
+    // Find voltage at the opamp's negative terminal
+    float nrc = rp * rfb;
+    float nrp = rc * rfb;
+    float nrfb = rc * rp;
+    float vneg = (vc * nrc + vp * nrp + vout * nrfb) / (nrc + nrp + nrfb);
+
+    // Find output current
+    float iout = (vneg - vout) / rfb;
+
+    return std::max(iout, 0.f);
+}
+
+// Model of LM13700 OTA VCA, neglecting linearizing diodes
+// vp: voltage at positive input terminal
+// vn: voltage at negative input terminal
+// i_abc: amplifier bias current
+// returns: OTA output current
+template <typename T>
+inline T OTAVCA(T vp, T vn, T i_abc)
+{
+    // For the derivation of this equation, see this fantastic paper:
+    //   http://www.openmusiclabs.com/files/otadist.pdf
+    // Thanks guest!
+    //
+    //   i_out = i_abc * (e^(vi/vt) - 1) / (e^(vi/vt) + 1)
+    // or equivalently,
+    //   i_out = i_abc * tanh(vi / (2vt))
+
+    T vi = vp - vn;
+
+    // Pade approximant of tanh, see FastMath.hpp
+    return i_abc * fastTanh(vi / (2 * kOTAVt));
+}
+
+// Small-signal gain around the resonance loop for a given control current.
+// The four cells each contribute 1/sqrt(2) at the 180 degree frequency, so
+// the filter self-oscillates once this exceeds kSelfOscillationLoopGain.
+inline float ResonanceLoopGain(float i_reso)
+{
+    return kFilterCellR * i_reso / (2.f * kOTAVt) * kFeedbackGain;
+}
+
+static const float kSelfOscillationLoopGain = 4.f;
+
+// Cheap per-engine white noise (xorshift32) used to bootstrap
+// self-oscillation, in place of the shared random::uniform() generator
+class NoiseSource
+{
+public:
+    NoiseSource()
+    {
+        state_ = random::u32() | 1u;
+    }
+
+    // Returns uniform noise in [-0.5, 0.5)
+    float Next()
+    {
+        state_ ^= state_ << 13;
+        state_ ^= state_ >> 17;
+        state_ ^= state_ << 5;
+        return state_ * 0x1p-32f - 0.5f;
+    }
+
+protected:
+    uint32_t state_;
+};
+
 
 
 class RipplesEngine
 {
 public:
+    // ODE solvers available for the filter core. Cheaper solvers can be
+    // traded against a higher oversampling ratio; see bench/RipplesSolvers.cpp
+    enum Solver
+    {
+        SOLVER_EULER,       // Forward Euler, 1 evaluation per step
+        SOLVER_RK2,         // Midpoint method, 2 evaluations per step
+        SOLVER_RK4,         // Classic Runge-Kutta, 4 evaluations per step
+        SOLVER_TRAPEZOIDAL, // Semi-implicit trapezoidal, 2 evaluations per step
+        NUM_SOLVERS
+    };
+
     struct Frame
     {
         // Parameters
@@ -132,9 +229,13 @@ public:
         float input = 0.f;
         //float gain_cv;
         //bool gain_cv_present;
+        // addLowend and clipOutputs are only read by process(); a core
+        // selected with getProcessFunction() has them built in instead
         bool addLowend = true;
         bool gainCompensation = true;
         bool clipOutputs = true;
+        // Only read by the 1x models, see Clip4ADAA
+        bool antialiasClipping = false;
 
         // Outputs (modified)
         float hp2 = 0.f;
@@ -143,34 +244,142 @@ public:
         float unused = 0.f;
     };
 
+    // Engine core specialised for a solver and a set of Frame flags
+    typedef void (RipplesEngine::*ProcessFunction)(Frame& frame);
+
     RipplesEngine()
     {
         setSampleRate(1.f);
     }
 
-    void setSampleRate(float sample_rate)
+    // Requests the anti-aliasing design for sample_rate, to be passed to
+    // setSampleRate(). Not real-time safe, so call this from the UI thread or
+    // a sample rate change.
+    static const AAFilterCache::Entry* requestAntialiasing(float sample_rate)
+    {
+        return AAFilter<simd::float_4>::Request(sample_rate);
+    }
+
+    // Without aa_design, rates that aren't among kAACommonRates keep the
+    // anti-aliasing table for the next lower one
+    void setSampleRate(float sample_rate,
+        const AAFilterCache::Entry* aa_design = nullptr)
     {
         sample_time_ = 1.f / sample_rate;
         cell_voltage_ = 0.f;
 
-        aa_filter_.Init(sample_rate);
+        aa_filter_.Init(sample_rate, aa_design);
+        InitOversampling();
 
-        float oversample_rate =
-            sample_rate * aa_filter_.GetOversamplingFactor();
+        // Start on the per-sample path so the coefficients don't ramp in
+        audio_rate_hold_ = kAudioRateHoldSamples;
+        control_phase_ = 0;
+        control_ = 0.f;
+        control_step_ = 0.f;
+        cv_history_[0] = 0.f;
+        cv_history_[1] = 0.f;
+    }
 
-        float freq_cut = 1.f / (2.f * M_PI * kFreqAmpR * kFreqAmpC);
-        float res_cut  = 1.f / (2.f * M_PI * kResAmpR  * kResAmpC);
-        float gain_cut = 1.f / (2.f * M_PI * kGainAmpR * kGainAmpC);
-        float ff_cut = 1.f / (2.f * M_PI * kFeedforwardR * kFeedforwardC);
+    // Clears the filter core, e.g. after the engine has been sleeping.
+    // Control and anti-aliasing filter states are kept so that the cutoff
+    // and resonance don't glide in from zero, unless this is where a new
+    // anti-aliasing design gets switched in.
+    void reset()
+    {
+        cell_voltage_ = 0.f;
+        updateAntialiasing();
+    }
 
-        auto cutoffs = simd::float_4(ff_cut, freq_cut, res_cut, gain_cut);
-        rc_filters_.setCutoffFreq(cutoffs / oversample_rate);
+    // Whether a runtime anti-aliasing design is ready to be switched in
+    bool isAntialiasingUpdateReady() const
+    {
+        return aa_filter_.IsUpdateReady();
+    }
 
-        float vca_cut = 1.f / (2.f * M_PI * kVCAInputR * kVCAInputC);
-        vca_hpf_.setCutoffFreq(vca_cut / oversample_rate);
+    // Switches to the anti-aliasing filter designed for this sample rate,
+    // once it's ready, and returns true if it did. That clears the filter's
+    // state and may change the oversampling factor, so only call this while
+    // the engine is silent, or on a copy that is faded in.
+    bool updateAntialiasing()
+    {
+        if (aa_filter_.Update())
+        {
+            InitOversampling();
+            return true;
+        }
+        return false;
+    }
+
+    // Seeds the filter core, e.g. from a linear model that has been running
+    // in place of this engine
+    void setCellVoltages(simd::float_4 cell_voltages)
+    {
+        cell_voltage_ = cell_voltages;
+    }
+
+    simd::float_4 getCellVoltages() const
+    {
+        return cell_voltage_;
+    }
+
+    // Delay of the outputs at low frequencies, in samples at the host rate.
+    // Nearly all of it is the anti-aliasing filters' group delay, so models
+    // running at 1x can be delayed by this much to line up with the engine.
+    float getLatency() const
+    {
+        return latency_;
+    }
+
+    void setSolver(Solver solver)
+    {
+        solver_ = solver;
+    }
+
+    Solver getSolver() const
+    {
+        return solver_;
+    }
+
+    // Returns the core matching the current solver and the given flags, so
+    // that callers can select it once rather than branch on every sample:
+    //   (engine.*engine.getProcessFunction(clip, lowend))(frame);
+    ProcessFunction getProcessFunction(bool clip_outputs, bool add_lowend) const
+    {
+        switch (solver_)
+        {
+            case SOLVER_EULER:
+                return SelectProcess<SOLVER_EULER>(clip_outputs, add_lowend);
+            case SOLVER_RK4:
+                return SelectProcess<SOLVER_RK4>(clip_outputs, add_lowend);
+            case SOLVER_TRAPEZOIDAL:
+                return SelectProcess<SOLVER_TRAPEZOIDAL>(clip_outputs,
+                    add_lowend);
+            case SOLVER_RK2:
+            default:
+                return SelectProcess<SOLVER_RK2>(clip_outputs, add_lowend);
+        }
     }
 
     void process(Frame& frame)
+    {
+        (this->*getProcessFunction(frame.clipOutputs, frame.addLowend))(frame);
+    }
+
+protected:
+    template <Solver solver>
+    static ProcessFunction SelectProcess(bool clip_outputs, bool add_lowend)
+    {
+        if (clip_outputs)
+        {
+            return add_lowend ? &RipplesEngine::Process<solver, true, true>
+                : &RipplesEngine::Process<solver, true, false>;
+        }
+        return add_lowend ? &RipplesEngine::Process<solver, false, true>
+            : &RipplesEngine::Process<solver, false, false>;
+    }
+
+    template <Solver solver, bool clip_outputs, bool add_lowend>
+    void Process(Frame& frame)
     {
         // Calculate equivalent frequency CV
         float v_oct = 0.f;
@@ -179,9 +388,15 @@ public:
         v_oct += frame.fm_cv * frame.fm_knob;
         v_oct = std::min(v_oct, 0.f);
 
-        // Calculate resonance control current
-        float i_reso = VtoIConverter(kResAmpR, frame.res_cv, kResInputR,
-            frame.res_knob * kResKnobV, kResKnobR);
+        // Find the control values (cutoff, i_reso, gain compensation), either
+        // every sample or interpolated from the control-rate stage. v_oct
+        // itself stays per-sample: while it moves at audio rate, the core
+        // lowpasses it and exponentiates it every oversampled step instead.
+        ControlProcess(frame, v_oct);
+        float rad_per_s = control_[0];
+        float i_reso = control_[1];
+        float gainCompensation = control_[2];
+        bool audio_rate_cv = audio_rate_hold_ > 0;
 
         // Calculate gain control current (unused)
         /*
@@ -199,28 +414,26 @@ public:
         int oversampling_factor = aa_filter_.GetOversamplingFactor();
         float timestep = sample_time_ / oversampling_factor;
         // Add noise to input to bootstrap self-oscillation
-        float input = frame.input + 1e-6 * (random::uniform() - 0.5f);
+        float input = frame.input + 1e-6 * noise_.Next();
         auto inputs = simd::float_4(input, v_oct, i_reso, 0.f);
         inputs *= oversampling_factor;
         simd::float_4 outputs;
 
-        // apply heuristic gain compensation to keep level consistent across resonance settings
-        // https://www.desmos.com/calculator/gkyn81l5vv
-        float gainCompensation = (frame.gainCompensation) ? 1.0 / (0.5 + 0.5 * std::exp(-7 * frame.res_knob)) : 1.f;
-        // doesn't affect HP output though
+        // gain compensation doesn't affect HP output though
         float_4 gainsCompensation = simd::float_4(1.0, gainCompensation, gainCompensation, 1.0);
 
         for (int i = 0; i < oversampling_factor; i++)
         {
             inputs = aa_filter_.ProcessUp((i == 0) ? inputs : 0.f);
-            outputs = CoreProcess(inputs, timestep, frame.res_knob, frame.addLowend);  
+            outputs = CoreProcess<solver, add_lowend>(inputs, timestep,
+                frame.res_knob, rad_per_s, audio_rate_cv);
             outputs *= gainsCompensation;
 
-            if (frame.clipOutputs) {
+            if (clip_outputs) {
                 // optionall soft-clip at +-10V
                 outputs = clip4(outputs);
             }
-            
+
             outputs = aa_filter_.ProcessDown(outputs);
         }
 
@@ -230,17 +443,122 @@ public:
         frame.unused = outputs[3];
     }
 
-protected:
+    // Number of samples between control-rate coefficient updates
+    static const int kControlBlockSize = 16;
+    // Largest second difference of the CVs (per sample squared) for which
+    // linear interpolation over a block stays within about a cent
+    static constexpr float kAudioRateCurvature = 2.5e-5f;
+    // How long CVs must stay smooth before leaving the per-sample path
+    static const int kAudioRateHoldSamples = 1024;
+
     float sample_time_;
+    float latency_;
     simd::float_4 cell_voltage_;
     ripples::AAFilter<simd::float_4> aa_filter_;
     dsp::TRCFilter<simd::float_4> rc_filters_;
     dsp::TRCFilter<float> vca_hpf_;
+    Solver solver_ = SOLVER_RK2;
+    NoiseSource noise_;
+
+    simd::float_4 control_;         // (rad_per_s, i_reso, gain compensation, 0)
+    simd::float_4 control_step_;
+    simd::float_4 cv_history_[2];   // (v_oct, res_knob, res_cv, 0)
+    int control_phase_;
+    int audio_rate_hold_;
+
+    // Sets up the filters running at the oversampled rate
+    void InitOversampling()
+    {
+        int oversampling_factor = aa_filter_.GetOversamplingFactor();
+        float oversample_rate = oversampling_factor / sample_time_;
+
+        // Inputs go in on the first substep and outputs are taken from the
+        // last one, oversampling_factor - 1 substeps later
+        latency_ = (aa_filter_.GetGroupDelay() - (oversampling_factor - 1))
+            / oversampling_factor;
+
+        float freq_cut = 1.f / (2.f * M_PI * kFreqAmpR * kFreqAmpC);
+        float res_cut  = 1.f / (2.f * M_PI * kResAmpR  * kResAmpC);
+        float gain_cut = 1.f / (2.f * M_PI * kGainAmpR * kGainAmpC);
+        float ff_cut = 1.f / (2.f * M_PI * kFeedforwardR * kFeedforwardC);
+
+        auto cutoffs = simd::float_4(ff_cut, freq_cut, res_cut, gain_cut);
+        rc_filters_.setCutoffFreq(cutoffs / oversample_rate);
+
+        float vca_cut = 1.f / (2.f * M_PI * kVCAInputR * kVCAInputC);
+        vca_hpf_.setCutoffFreq(vca_cut / oversample_rate);
+    }
+
+    // Control-rate stage. The coefficients are recomputed every
+    // kControlBlockSize samples and linearly interpolated in between, unless
+    // the CVs are found to be moving at audio rate, in which case they are
+    // recomputed every sample until the CVs have settled again.
+    void ControlProcess(const Frame& frame, float v_oct)
+    {
+        simd::float_4 cv = simd::float_4(v_oct, frame.res_knob,
+            frame.res_cv, 0.f);
+        simd::float_4 curvature =
+            simd::abs(cv - 2.f * cv_history_[0] + cv_history_[1]);
+        cv_history_[1] = cv_history_[0];
+        cv_history_[0] = cv;
+
+        // Enter the per-sample path at once, but only leave it after a while
+        // below half the threshold
+        float max_curvature = std::max(std::max(curvature[0], curvature[1]),
+            curvature[2]);
+        if (max_curvature > kAudioRateCurvature)
+        {
+            audio_rate_hold_ = kAudioRateHoldSamples;
+        }
+        else if (max_curvature < 0.5f * kAudioRateCurvature
+            && audio_rate_hold_ > 0)
+        {
+            audio_rate_hold_--;
+        }
+
+        if (audio_rate_hold_ > 0)
+        {
+            control_ = ComputeControl(frame, v_oct);
+            control_step_ = 0.f;
+            control_phase_ = 0;
+            return;
+        }
+
+        if (control_phase_ == 0)
+        {
+            simd::float_4 target = ComputeControl(frame, v_oct);
+            control_step_ = (target - control_) / kControlBlockSize;
+        }
+        control_ += control_step_;
+        control_phase_ = (control_phase_ + 1) % kControlBlockSize;
+    }
+
+    simd::float_4 ComputeControl(const Frame& frame, float v_oct)
+    {
+        // Calculate resonance control current
+        float i_reso = VtoIConverter(kResAmpR, frame.res_cv, kResInputR,
+            frame.res_knob * kResKnobV, kResKnobR);
+
+        // apply heuristic gain compensation to keep level consistent across resonance settings
+        // https://www.desmos.com/calculator/gkyn81l5vv
+        float gainCompensation = (frame.gainCompensation) ? 1.0 / (0.5 + 0.5 * std::exp(-7 * frame.res_knob)) : 1.f;
+
+        // Calculate -A / RC of the filter cells, see CoreProcess(). Also
+        // computed on the per-sample path, so that interpolation resumes
+        // from the current cutoff.
+        float rad_per_s = -fastExp2(v_oct) / kFilterCellRC;
+
+        return simd::float_4(rad_per_s, i_reso, gainCompensation, 0.f);
+    }
 
     // High-rate processing core
     // inputs: vector containing (input, v_oct, i_reso, i_vca)
+    // control_rad_per_s: the cells' -A / RC from the control-rate stage, used
+    //   unless audio_rate_cv is set
     // returns: vector containing (bp2, lp2, lp4, lp4vca)
-    simd::float_4 CoreProcess(simd::float_4 inputs, float timestep, float res_knob, bool addLowend)
+    template <Solver solver, bool add_lowend>
+    simd::float_4 CoreProcess(simd::float_4 inputs, float timestep,
+        float res_knob, float control_rad_per_s, bool audio_rate_cv)
     {
         rc_filters_.process(inputs);
 
@@ -271,11 +589,15 @@ protected:
         //  Thus,
         //    dvout/dt = -A/(RC) * (vin + vout)
 
-        // Calculate -A / RC
-        simd::float_4 rad_per_s = -std::exp2f(v_oct) / kFilterCellRC;
+        // Calculate -A / RC. Audio-rate FM is exponentiated after the
+        // control filters, as in the circuit, which shapes its sidebands.
+        simd::float_4 rad_per_s = audio_rate_cv
+            ? -fastExp2(v_oct) / kFilterCellRC
+            : control_rad_per_s;
 
         // Emulate the filter core
-        cell_voltage_ = StepRK2(timestep, cell_voltage_, [&](simd::float_4 vout)
+        simd::float_4 vsum;
+        auto derivative = [&](simd::float_4 vout)
         {
             // vout contains the initial cell voltages (v0, v1 v2, v3)
 
@@ -295,14 +617,40 @@ protected:
             // Now, vin contains (in, v0, v1, v2)
             // and vout contains (v0, v1, v2, v3)
             // Their sum gives us vin + vout for each cell
-            simd::float_4 vsum = vin + vout;
+            vsum = vin + vout;
             simd::float_4 dvout = rad_per_s * vsum;
 
             // Generate some even-order harmonics via self-modulation
             dvout *= (1.f + vsum * kFilterCellSelfModulation);
 
             return dvout;
-        });
+        };
+
+        // Diagonal of the core's Jacobian at the point of the most recent
+        // derivative evaluation. Since vsum[n] = v[n-1] + v[n], it is also
+        // the subdiagonal. The resonance path into the first cell is ignored.
+        auto jacobian = [&]()
+        {
+            return rad_per_s * (1.f + 2.f * kFilterCellSelfModulation * vsum);
+        };
+
+        switch (solver)
+        {
+            case SOLVER_EULER:
+                cell_voltage_ = StepEuler(timestep, cell_voltage_, derivative);
+                break;
+            case SOLVER_RK4:
+                cell_voltage_ = StepRK4(timestep, cell_voltage_, derivative);
+                break;
+            case SOLVER_TRAPEZOIDAL:
+                cell_voltage_ = StepTrapezoidal(timestep, cell_voltage_,
+                    derivative, jacobian);
+                break;
+            case SOLVER_RK2:
+            default:
+                cell_voltage_ = StepRK2(timestep, cell_voltage_, derivative);
+                break;
+        }
 
         cell_voltage_ = simd::clamp(cell_voltage_, -kOpampSatV, kOpampSatV);
 
@@ -320,14 +668,21 @@ protected:
         float filterIn = inputs[0] * kFilterInputGain + res;
         float hp2 = (filterIn + 2*lp1 + lp2);
         
-        if (addLowend) {
+        if (add_lowend) {
             // add lowend shelving to hp2 output, proportional to resonance knob
             hp2 += res_knob * lp1;
         }
-        
+
         return simd::float_4(hp2*kHP2Gain, bp4*kBP4Gain, lp4*kLP4Gain, 0.f);
     }
 
+    // Solves an ODE system using the forward Euler method
+    template <typename T, typename F>
+    T StepEuler(float dt, T y, F f)
+    {
+        return y + dt * f(y);
+    }
+
     // Solves an ODE system using the 2nd order Runge-Kutta method
     template <typename T, typename F>
     T StepRK2(float dt, T y, F f)
@@ -337,63 +692,278 @@ protected:
         return y + dt * k2;
     }
 
-    // Model of Ripples nonlinear CV voltage-to-current converters
-    float VtoIConverter(
-        float rfb,                          // Amplifier feedback resistor
-        float vc, float rc,                 // CV voltage and input resistor
-        float vp = 0.f, float rp = 1e12f)   // Knob voltage and resistor
+    // Solves an ODE system using the classic 4th order Runge-Kutta method
+    template <typename T, typename F>
+    T StepRK4(float dt, T y, F f)
     {
-        // Find nominal voltage at the BJT collector, ignoring nonlinearity
-        float vnom = -(vc * rfb / rc + vp * rfb / rp);
+        T k1 = f(y);
+        T k2 = f(y + k1 * dt / 2.f);
+        T k3 = f(y + k2 * dt / 2.f);
+        T k4 = f(y + k3 * dt);
+        return y + dt / 6.f * (k1 + 2.f * k2 + 2.f * k3 + k4);
+    }
 
-        // Apply clipping - naive for now
-        float vout = std::max(vnom, kVtoICollectorVSat);
+    // Solves an ODE system using the trapezoidal rule, with a single Newton
+    // iteration starting from a forward Euler prediction. `jac` must return
+    // the diagonal of the Jacobian at the point of the last call to `f`; the
+    // system is assumed to be lower bidiagonal with equal diagonal and
+    // subdiagonal, which holds for the cascaded cells of the filter core.
+    template <typename T, typename F, typename J>
+    T StepTrapezoidal(float dt, T y, F f, J jac)
+    {
+        T k1 = f(y);
+        T y1 = y + dt * k1;
+        T k2 = f(y1);
+
+        // Residual of the trapezoidal rule at the predicted point
+        T g = y1 - y - dt / 2.f * (k1 + k2);
+
+        // Solve (I - dt/2 * J) * delta = -g by forward substitution
+        T a = dt / 2.f * jac();
+        T d = 1.f - a;
+        T delta;
+        delta[0] = -g[0] / d[0];
+        for (int n = 1; n < 4; n++)
+        {
+            delta[n] = (a[n] * delta[n - 1] - g[n]) / d[n];
+        }
 
-        // Find voltage at the opamp's negative terminal
-        float nrc = rp * rfb;
-        float nrp = rc * rfb;
-        float nrfb = rc * rp;
-        float vneg = (vc * nrc + vp * nrp + vout * nrfb) / (nrc + nrp + nrfb);
+        return y1 + delta;
+    }
+};
 
-        // Find output current
-        float iout = (vneg - vout) / rfb;
+// Zero-delay-feedback model of the Ripples filter core, intended to run at the
+// host rate without oversampling. Each vca-integrator cell is discretised with
+// the trapezoidal rule (topology-preserving transform), and the resonance loop
+// is solved implicitly by linearising the OTA around its operating point and
+// refining the estimate once. Since there is no unit delay in the loop, the
+// model stays stable and in tune up to full resonance.
+//
+// With linear = true, the OTA, cell self-modulation and opamp saturation are
+// all treated as linear, leaving a cheap model that matches the full ones at
+// low levels and resonance.
+template <bool linear>
+class RipplesZDFModel
+{
+public:
+    using Frame = RipplesEngine::Frame;
 
-        return std::max(iout, 0.f);
+    RipplesZDFModel()
+    {
+        setSampleRate(1.f);
     }
 
-    // Model of LM13700 OTA VCA, neglecting linearizing diodes
-    // vp: voltage at positive input terminal
-    // vn: voltage at negative input terminal
-    // i_abc: amplifier bias current
-    // returns: OTA output current
-    template <typename T>
-    T OTAVCA(T vp, T vn, T i_abc)
+    void setSampleRate(float sample_rate)
     {
-        // For the derivation of this equation, see this fantastic paper:
-        //   http://www.openmusiclabs.com/files/otadist.pdf
-        // Thanks guest!
-        //
-        //   i_out = i_abc * (e^(vi/vt) - 1) / (e^(vi/vt) + 1)
-        // or equivalently,
-        //   i_out = i_abc * tanh(vi / (2vt))
+        sample_rate_ = sample_rate;
+        sample_time_ = 1.f / sample_rate;
+        reset();
+
+        float freq_cut = 1.f / (2.f * M_PI * kFreqAmpR * kFreqAmpC);
+        float res_cut  = 1.f / (2.f * M_PI * kResAmpR  * kResAmpC);
+        float gain_cut = 1.f / (2.f * M_PI * kGainAmpR * kGainAmpC);
+        float ff_cut = 1.f / (2.f * M_PI * kFeedforwardR * kFeedforwardC);
+
+        // Some of the amplifier poles sit above Nyquist at common host rates,
+        // so keep them below it rather than let the RC filters misbehave
+        auto cutoffs = simd::float_4(ff_cut, freq_cut, res_cut, gain_cut);
+        cutoffs = simd::fmin(cutoffs, kMaxCutoffRatio * sample_rate);
+        rc_filters_.setCutoffFreq(cutoffs / sample_rate);
+    }
+
+    // Clears the filter core, keeping the control filter states
+    void reset()
+    {
+        for (int n = 0; n < 4; n++)
+        {
+            state_[n] = 0.f;
+            cell_voltage_[n] = 0.f;
+        }
+        filter_in_ = 0.f;
+        z_ = 0.f;
+        g_v_oct_ = NAN;
+        clipper_.reset();
+    }
+
+    simd::float_4 getCellVoltages() const
+    {
+        return simd::float_4(cell_voltage_[0], cell_voltage_[1],
+            cell_voltage_[2], cell_voltage_[3]);
+    }
+
+    // Seeds the filter core, e.g. from another model that has been running
+    // in its place. The integrators are assumed to be at rest.
+    void setCellVoltages(simd::float_4 cell_voltages)
+    {
+        for (int n = 0; n < 4; n++)
+        {
+            state_[n] = cell_voltages[n];
+            cell_voltage_[n] = cell_voltages[n];
+        }
+        filter_in_ = 0.f;
+    }
+
+    void process(Frame& frame)
+    {
+        // Calculate equivalent frequency CV
+        float v_oct = 0.f;
+        v_oct += (frame.freq_knob - 1.f) * kFreqKnobVoltage;
+        v_oct += frame.freq_cv;
+        v_oct += frame.fm_cv * frame.fm_knob;
+        v_oct = std::min(v_oct, 0.f);
 
-        const float kTemperature = 40.f; // Silicon temperature in Celsius
-        const float kKoverQ = 8.617333262145e-5;
-        const float kKelvin = 273.15f; // 0C in K
-        const float kVt = kKoverQ * (kTemperature + kKelvin);
-        const float kZlim = 2.f * std::sqrt(3.f);
+        // Calculate resonance control current
+        float i_reso = VtoIConverter(kResAmpR, frame.res_cv, kResInputR,
+            frame.res_knob * kResKnobV, kResKnobR);
 
-        T vi = vp - vn;
-        T zlim = kZlim;
-        T z = math::clamp(vi / (2 * kVt), -zlim, zlim);
+        // Add noise to input to bootstrap self-oscillation
+        float input = frame.input + 1e-6 * noise_.Next();
+        rc_filters_.process(simd::float_4(input, v_oct, i_reso, 0.f));
 
-        // Pade approximant of tanh(z)
-        T z2 = z * z;
-        T q = 12.f + z2;
-        T p = 12.f * z * q / (36.f * z2 + q * q);
+        // Lowpass the control signals, highpass the input for the feedforward
+        simd::float_4 control = rc_filters_.lowpass();
+        v_oct = control[1];
+        i_reso = control[2];
+        float feedforward = rc_filters_.highpass()[0];
 
-        return i_abc * p;
+        // Prewarped integrator gain, only recomputed when the cutoff moves
+        if (v_oct != g_v_oct_)
+        {
+            float cutoff = kFilterMaxCutoff * fastExp2(v_oct);
+            cutoff = std::min(cutoff, kMaxCutoffRatio * sample_rate_);
+            g_ = std::tan(M_PI * cutoff * sample_time_);
+            g_v_oct_ = v_oct;
+        }
+        float g = g_;
+
+        // Each cell resolves to vout = -G[n] * vin + S[n], where S[n] is its
+        // scaled integrator state. Self-modulation is applied to the cell
+        // gain using the voltages from the previous sample.
+        float G[4];
+        float S[4];
+        for (int n = 0; n < 4; n++)
+        {
+            float gn = g;
+            if (!linear)
+            {
+                float vin = (n == 0) ? filter_in_ : cell_voltage_[n - 1];
+                float vsum = vin + cell_voltage_[n];
+                gn = std::max(g * (1.f + vsum * kFilterCellSelfModulation), 0.f);
+            }
+            G[n] = gn / (1.f + gn);
+            S[n] = state_[n] / (1.f + gn);
+        }
+
+        // Express the last cell's output as lp4 = a * in + b
+        float a = 1.f;
+        float b = 0.f;
+        for (int n = 0; n < 4; n++)
+        {
+            a = -G[n] * a;
+            b = -G[n] * b + S[n];
+        }
+
+        // Solve the resonance loop
+        //   in = vin + R * i_reso * tanh(z)
+        //   z = (vp - vn) / 2vt, with vn = lp4 * kFeedbackGain
+        // with tanh(z) replaced by its secant m * z through the last estimate
+        float vin = input * kFilterInputGain;
+        float vp = feedforward * kFeedforwardGain;
+        float k = kFilterCellR * i_reso / (2.f * kOTAVt);
+        float lp4 = 0.f;
+        float res = 0.f;
+        if (linear)
+        {
+            lp4 = (a * (vin + k * vp) + b) / (1.f + a * k * kFeedbackGain);
+            res = k * (vp - lp4 * kFeedbackGain);
+        }
+        else
+        {
+            for (int i = 0; i < 2; i++)
+            {
+                float km = k * OTASlope(z_);
+                lp4 = (a * (vin + km * vp) + b)
+                    / (1.f + a * km * kFeedbackGain);
+                z_ = (vp - lp4 * kFeedbackGain) / (2.f * kOTAVt);
+            }
+            res = kFilterCellR * OTAVCA(vp, lp4 * kFeedbackGain, i_reso);
+        }
+
+        float x = vin + res;
+        filter_in_ = x;
+
+        // Run the cascade from the resolved input and update the states
+        for (int n = 0; n < 4; n++)
+        {
+            float y = -G[n] * x + S[n];
+            if (!linear)
+            {
+                y = math::clamp(y, -kOpampSatV, kOpampSatV);
+            }
+            state_[n] = 2.f * y - state_[n];
+            cell_voltage_[n] = y;
+            x = y;
+        }
+
+        float lp1 = cell_voltage_[0];
+        float lp2 = cell_voltage_[1];
+        float lp3 = cell_voltage_[2];
+        lp4 = cell_voltage_[3];
+
+        float bp4 = (lp2 + 2*lp3 + lp4);
+        float hp2 = (filter_in_ + 2*lp1 + lp2);
+
+        if (frame.addLowend) {
+            // add lowend shelving to hp2 output, proportional to resonance knob
+            hp2 += frame.res_knob * lp1;
+        }
+
+        // same heuristic gain compensation as RipplesEngine (HP unaffected)
+        float gainCompensation = (frame.gainCompensation) ? 1.0 / (0.5 + 0.5 * std::exp(-7 * frame.res_knob)) : 1.f;
+        simd::float_4 outputs = simd::float_4(hp2*kHP2Gain, bp4*kBP4Gain, lp4*kLP4Gain, 0.f);
+        outputs *= simd::float_4(1.0, gainCompensation, gainCompensation, 1.0);
+
+        if (frame.clipOutputs) {
+            // optionally soft-clip at +-10V, and optionally anti-aliased as
+            // the model isn't oversampled
+            outputs = frame.antialiasClipping ? clipper_.process(outputs)
+                : clipper_.processNaive(outputs);
+        }
+
+        frame.hp2     = outputs[0];
+        frame.bp4     = outputs[1];
+        frame.lp4     = outputs[2];
+        frame.unused = outputs[3];
+    }
+
+protected:
+    // Highest cutoff, relative to the sample rate, of any filter in the model
+    static constexpr float kMaxCutoffRatio = 0.45f;
+
+    float sample_rate_;
+    float sample_time_;
+    float state_[4];
+    float cell_voltage_[4];
+    float filter_in_;
+    float z_;
+    float g_;
+    float g_v_oct_;
+    dsp::TRCFilter<simd::float_4> rc_filters_;
+    NoiseSource noise_;
+    Clip4ADAA<simd::float_4> clipper_;
+
+    // Secant slope p(z) / z of the OTA's transfer curve
+    static float OTASlope(float z)
+    {
+        if (std::abs(z) < 1e-4f)
+        {
+            return 1.f;
+        }
+        return OTAVCA(2.f * kOTAVt * z, 0.f, 1.f) / z;
     }
 };
 
+typedef RipplesZDFModel<false> RipplesZDFEngine;
+typedef RipplesZDFModel<true> RipplesLinearEngine;
+
 }
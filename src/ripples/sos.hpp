@@ -79,6 +79,20 @@ public:
         }
     }
 
+    // Group delay at DC, in samples
+    float GetGroupDelay() const
+    {
+        float delay = 0.f;
+        for (int n = 0; n < num_sections_; n++)
+        {
+            const float* b = sections_[n].b;
+            const float* a = sections_[n].a;
+            delay += (b[1] + 2.f * b[2]) / (b[0] + b[1] + b[2]);
+            delay -= (a[0] + 2.f * a[1]) / (1.f + a[0] + a[1]);
+        }
+        return delay;
+    }
+
     T Process(T in)
     {
         for (int n = 0; n < num_sections_; n++)